@@ -1,13 +1,23 @@
 #include "Capture.h"
 #include <iostream>
 #include <cstdlib> // 为了 getenv
+#include <chrono>
+#include <string>
 extern "C"
 {
 #include <libavdevice/avdevice.h>
 }
 
-Capture::Capture(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> queue)
-    : raw_frame_queue_(queue) {}
+namespace
+{
+// 两种后端共用的采集参数
+constexpr int kCaptureFramerate = 30;
+constexpr int kCaptureWidth = 1920;
+constexpr int kCaptureHeight = 1080;
+}
+
+Capture::Capture(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> queue, CaptureBackend backend)
+    : backend_(backend), raw_frame_queue_(queue) {}
 
 Capture::~Capture()
 {
@@ -15,6 +25,59 @@ Capture::~Capture()
 }
 
 bool Capture::start()
+{
+    if (backend_ == CaptureBackend::XcbShm)
+    {
+        return start_xcb_shm();
+    }
+    if (backend_ == CaptureBackend::XcbDamage)
+    {
+        return start_xcb_damage();
+    }
+    return start_x11grab();
+}
+
+bool Capture::start_xcb_shm()
+{
+    const char *display_name = getenv("DISPLAY");
+    if (!display_name)
+    {
+        std::cerr << "[Capture] ERROR: DISPLAY environment variable not set." << std::endl;
+        return false;
+    }
+
+    xcb_grabber_ = std::make_unique<XcbShmGrabber>();
+    if (!xcb_grabber_->open(display_name, kCaptureWidth, kCaptureHeight))
+    {
+        std::cerr << "[Capture] ERROR: Cannot open XCB SHM grabber on '" << display_name << "'." << std::endl;
+        xcb_grabber_.reset();
+        return false;
+    }
+    std::cout << "[Capture] Started successfully using XCB SHM." << std::endl;
+    return true;
+}
+
+bool Capture::start_xcb_damage()
+{
+    const char *display_name = getenv("DISPLAY");
+    if (!display_name)
+    {
+        std::cerr << "[Capture] ERROR: DISPLAY environment variable not set." << std::endl;
+        return false;
+    }
+
+    damage_grabber_ = std::make_unique<XcbDamageGrabber>();
+    if (!damage_grabber_->open(display_name, kCaptureWidth, kCaptureHeight))
+    {
+        std::cerr << "[Capture] ERROR: Cannot open XDamage grabber on '" << display_name << "'." << std::endl;
+        damage_grabber_.reset();
+        return false;
+    }
+    std::cout << "[Capture] Started successfully using XDamage." << std::endl;
+    return true;
+}
+
+bool Capture::start_x11grab()
 {
     avdevice_register_all();
 
@@ -26,8 +89,8 @@ bool Capture::start()
     }
 
     AVDictionary *options = nullptr;
-    av_dict_set(&options, "framerate", "30", 0);
-    av_dict_set(&options, "video_size", "1920x1080", 0);
+    av_dict_set(&options, "framerate", std::to_string(kCaptureFramerate).c_str(), 0);
+    av_dict_set(&options, "video_size", (std::to_string(kCaptureWidth) + "x" + std::to_string(kCaptureHeight)).c_str(), 0);
     // 尝试添加 draw_mouse=0 来隐藏鼠标指针
     av_dict_set(&options, "draw_mouse", "0", 0);
 
@@ -95,17 +158,106 @@ bool Capture::start()
 
 void Capture::stop()
 {
-    stop_flag_ = true;
+    {
+        std::lock_guard<std::mutex> lock(pause_mutex_);
+        stop_flag_ = true;
+    }
+    pause_cv_.notify_all();   // 唤醒可能处于暂停状态的采集线程
     raw_frame_queue_->stop(); // 通知队列停止
 }
 
+void Capture::pause()
+{
+    std::lock_guard<std::mutex> lock(pause_mutex_);
+    paused_ = true;
+}
+
+void Capture::resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(pause_mutex_);
+        paused_ = false;
+    }
+    pause_cv_.notify_all();
+}
+
+bool Capture::wait_while_paused()
+{
+    std::unique_lock<std::mutex> lock(pause_mutex_);
+    if (!paused_ || stop_flag_)
+        return false;
+
+    std::cout << "[Capture] Paused, no client is playing." << std::endl;
+    pause_cv_.wait(lock, [this]
+                   { return !paused_ || stop_flag_; });
+    std::cout << "[Capture] Resumed." << std::endl;
+    return true;
+}
+
 void Capture::run()
+{
+    if (backend_ == CaptureBackend::XcbShm || backend_ == CaptureBackend::XcbDamage)
+    {
+        run_xcb();
+    }
+    else
+    {
+        run_x11grab();
+    }
+    std::cout << "[Capture] Thread finished." << std::endl;
+}
+
+void Capture::run_xcb()
+{
+    const auto frame_interval = std::chrono::microseconds(1000000 / kCaptureFramerate);
+    auto next_frame_time = std::chrono::steady_clock::now();
+
+    while (!stop_flag_)
+    {
+        if (wait_while_paused())
+        {
+            next_frame_time = std::chrono::steady_clock::now(); // 恢复后立即采集，重新对齐节拍
+            continue;
+        }
+
+        auto frame = xcb_grabber_ ? xcb_grabber_->grab() : damage_grabber_->grab();
+        if (frame)
+        {
+            raw_frame_queue_->push(std::move(frame));
+        }
+        // 返回空帧说明所有缓冲仍被下游占用，直接丢弃本帧
+
+        // 按固定帧率节拍采集；落后超过一帧时重新对齐，避免追帧
+        next_frame_time += frame_interval;
+        auto now = std::chrono::steady_clock::now();
+        if (next_frame_time < now - frame_interval)
+        {
+            next_frame_time = now;
+        }
+        std::this_thread::sleep_until(next_frame_time);
+    }
+}
+
+void Capture::run_x11grab()
 {
     auto packet = make_av_packet();
     auto frame = make_av_frame();
 
     while (!stop_flag_)
     {
+        if (wait_while_paused())
+        {
+            if (stop_flag_)
+                break;
+            // x11grab 按打开时的时钟节拍取帧，暂停之后会不加间隔地连续追帧，因此重新打开设备
+            if (!start_x11grab())
+            {
+                std::cerr << "[Capture] ERROR: Failed to reopen x11grab after resume." << std::endl;
+                break;
+            }
+            continue;
+        }
+
         // 使用 get() 获取原始指针
         int ret = av_read_frame(in_fmt_ctx_ptr_.get(), packet.get());
         if (ret < 0)
@@ -156,5 +308,4 @@ void Capture::run()
         // 短暂休眠，避免CPU空转 (可以根据需要调整)
         // std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-    std::cout << "[Capture] Thread finished." << std::endl;
 }
\ No newline at end of file
@@ -2,26 +2,55 @@
 
 #include "FFMpegWrappers.h"
 #include "ThreadSafeQueue.h"
+#include "XcbShmGrabber.h"
+#include "XcbDamageGrabber.h"
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 // 前向声明，避免循环包含
 struct AVFormatContext;
 struct AVCodecContext;
 
+// 屏幕采集后端
+enum class CaptureBackend
+{
+    X11Grab, // libavdevice x11grab + rawvideo 解码器
+    XcbShm,    // 原生 XCB + MIT-SHM，帧直接指向共享内存
+    XcbDamage, // XDamage 增量采集，只读取变化区域，帧携带脏矩形
+};
+
 class Capture
 {
 public:
-    Capture(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> queue);
+    Capture(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> queue, CaptureBackend backend = CaptureBackend::X11Grab);
     ~Capture();
     bool start();
     void stop();
     void run();
 
+    // 暂停/恢复采集：没有客户端在播放时暂停，避免空转占用 CPU
+    void pause();
+    void resume();
+
 private:
+    // 处于暂停状态时阻塞到恢复或停止；返回 true 表示刚从暂停中醒来
+    bool wait_while_paused();
+    bool start_x11grab();
+    bool start_xcb_shm();
+    bool start_xcb_damage();
+    void run_x11grab();
+    void run_xcb();
+
+    CaptureBackend backend_;
     std::shared_ptr<ThreadSafeQueue<AVFramePtr>> raw_frame_queue_;
     std::atomic_bool stop_flag_{false};
 
+    std::mutex pause_mutex_;
+    std::condition_variable pause_cv_;
+    bool paused_ = false;
+
     // 使用原始指针，但生命周期由智能指针在析构函数中管理（或者手动管理）
     // 或者使用智能指针，但要小心所有权传递和生命周期问题
     AVFormatContext *in_fmt_ctx_ = nullptr;       // 用 reset 管理
@@ -30,4 +59,7 @@ private:
     AVCodecContextPtr dec_ctx_ptr_ = nullptr;     // 使用智能指针管理解码上下文
 
     int video_stream_index_ = -1;
+
+    std::unique_ptr<XcbShmGrabber> xcb_grabber_;       // XcbShm 后端使用
+    std::unique_ptr<XcbDamageGrabber> damage_grabber_; // XcbDamage 后端使用
 };
\ No newline at end of file
@@ -0,0 +1,559 @@
+#include "ColorConverter.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLOR_CONVERT_X86 1
+#endif
+
+namespace
+{
+// BT.601 limited range 定点系数（8 位小数）：
+//   Y = ((66R + 129G + 25B + 128) >> 8) + 16
+//   U = (112B - 74G - 38R + 32896) >> 8
+//   V = (112R - 94G - 18B + 32896) >> 8
+// 所有中间值都落在 [0, 65535]，SIMD 实现可以直接用 16 位无符号（模 2^16）运算得到相同结果
+inline uint8_t luma(const uint8_t *px)
+{
+    return (uint8_t)(((66 * px[2] + 129 * px[1] + 25 * px[0] + 128) >> 8) + 16);
+}
+
+// 标量实现，从第 x 列（偶数）处理到行尾；也用于 SIMD 实现的尾部
+template <bool kNV12>
+void rows_tail(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+               uint8_t *u, uint8_t *v, int x, int width)
+{
+    for (; x < width; x += 2)
+    {
+        int x1 = std::min(x + 1, width - 1); // 奇数宽度时最后一列与自身配对
+        const uint8_t *a0 = src0 + (size_t)x * 4;
+        const uint8_t *a1 = src0 + (size_t)x1 * 4;
+        const uint8_t *b0 = src1 + (size_t)x * 4;
+        const uint8_t *b1 = src1 + (size_t)x1 * 4;
+
+        y0[x] = luma(a0);
+        y0[x1] = luma(a1);
+        y1[x] = luma(b0);
+        y1[x1] = luma(b1);
+
+        int b = (a0[0] + a1[0] + b0[0] + b1[0] + 2) >> 2;
+        int g = (a0[1] + a1[1] + b0[1] + b1[1] + 2) >> 2;
+        int r = (a0[2] + a1[2] + b0[2] + b1[2] + 2) >> 2;
+        uint8_t cb = (uint8_t)((112 * b - 74 * g - 38 * r + 32896) >> 8);
+        uint8_t cr = (uint8_t)((112 * r - 94 * g - 18 * b + 32896) >> 8);
+        if (kNV12)
+        {
+            u[x] = cb;
+            u[x + 1] = cr;
+        }
+        else
+        {
+            u[x / 2] = cb;
+            v[x / 2] = cr;
+        }
+    }
+}
+
+template <bool kNV12>
+void rows_c(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+            uint8_t *u, uint8_t *v, int width)
+{
+    rows_tail<kNV12>(src0, src1, y0, y1, u, v, 0, width);
+}
+
+#ifdef COLOR_CONVERT_X86
+// 各 SIMD 实现结构相同：
+//   1. 每像素 32 位 B|G<<8|R<<16，按位与/移位拆出三个通道，packus 成 16 位
+//   2. 16 位乘加算出亮度；两行相加后用 madd 做水平相邻像素求和，得到 2x2 均值再算色度
+//   3. packus 在 256/512 位寄存器上按 128 位通道交错，最后用一次 32 位置换恢复像素顺序
+
+// ---------------- SSE4.1：每次 16 像素 ----------------
+__attribute__((target("sse4.1"))) inline void split_sse41(__m128i p0, __m128i p1, __m128i &b, __m128i &g, __m128i &r)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    b = _mm_packus_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    g = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    r = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+__attribute__((target("sse4.1"))) inline __m128i luma_sse41(__m128i b, __m128i g, __m128i r)
+{
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(y, _mm_set1_epi16(16));
+}
+
+// 两行通道和 → 2x2 均值（16 位）
+__attribute__((target("sse4.1"))) inline __m128i average_sse41(__m128i sum_lo, __m128i sum_hi)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128i lo = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(sum_lo, ones), two), 2);
+    __m128i hi = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(sum_hi, ones), two), 2);
+    return _mm_packus_epi32(lo, hi);
+}
+
+__attribute__((target("sse4.1"))) inline __m128i chroma_sse41(__m128i c112, __m128i c1, __m128i k1, __m128i c2, __m128i k2)
+{
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(c112, _mm_set1_epi16(112)), _mm_set1_epi16((short)32896));
+    x = _mm_sub_epi16(x, _mm_mullo_epi16(c1, k1));
+    x = _mm_sub_epi16(x, _mm_mullo_epi16(c2, k2));
+    return _mm_srli_epi16(x, 8);
+}
+
+template <bool kNV12>
+__attribute__((target("sse4.1"))) void rows_sse41(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                                                   uint8_t *u, uint8_t *v, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const __m128i *s0 = (const __m128i *)(src0 + (size_t)x * 4);
+        const __m128i *s1 = (const __m128i *)(src1 + (size_t)x * 4);
+        __m128i b0l, g0l, r0l, b0h, g0h, r0h, b1l, g1l, r1l, b1h, g1h, r1h;
+        split_sse41(_mm_loadu_si128(s0), _mm_loadu_si128(s0 + 1), b0l, g0l, r0l);
+        split_sse41(_mm_loadu_si128(s0 + 2), _mm_loadu_si128(s0 + 3), b0h, g0h, r0h);
+        split_sse41(_mm_loadu_si128(s1), _mm_loadu_si128(s1 + 1), b1l, g1l, r1l);
+        split_sse41(_mm_loadu_si128(s1 + 2), _mm_loadu_si128(s1 + 3), b1h, g1h, r1h);
+
+        _mm_storeu_si128((__m128i *)(y0 + x), _mm_packus_epi16(luma_sse41(b0l, g0l, r0l), luma_sse41(b0h, g0h, r0h)));
+        _mm_storeu_si128((__m128i *)(y1 + x), _mm_packus_epi16(luma_sse41(b1l, g1l, r1l), luma_sse41(b1h, g1h, r1h)));
+
+        __m128i b = average_sse41(_mm_add_epi16(b0l, b1l), _mm_add_epi16(b0h, b1h));
+        __m128i g = average_sse41(_mm_add_epi16(g0l, g1l), _mm_add_epi16(g0h, g1h));
+        __m128i r = average_sse41(_mm_add_epi16(r0l, r1l), _mm_add_epi16(r0h, r1h));
+        __m128i cb = chroma_sse41(b, g, _mm_set1_epi16(74), r, _mm_set1_epi16(38));
+        __m128i cr = chroma_sse41(r, g, _mm_set1_epi16(94), b, _mm_set1_epi16(18));
+        if (kNV12)
+        {
+            _mm_storeu_si128((__m128i *)(u + x), _mm_or_si128(cb, _mm_slli_epi16(cr, 8)));
+        }
+        else
+        {
+            __m128i packed = _mm_packus_epi16(cb, cr);
+            _mm_storel_epi64((__m128i *)(u + x / 2), packed);
+            _mm_storel_epi64((__m128i *)(v + x / 2), _mm_srli_si128(packed, 8));
+        }
+    }
+    rows_tail<kNV12>(src0, src1, y0, y1, u, v, x, width);
+}
+
+// ---------------- AVX2：每次 32 像素 ----------------
+__attribute__((target("avx2"))) inline void split_avx2(__m256i p0, __m256i p1, __m256i &b, __m256i &g, __m256i &r)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    b = _mm256_packus_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask));
+    g = _mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask), _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask));
+    r = _mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask), _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask));
+}
+
+__attribute__((target("avx2"))) inline __m256i luma_avx2(__m256i b, __m256i g, __m256i r)
+{
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)), _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(25)));
+    y = _mm256_srli_epi16(_mm256_add_epi16(y, _mm256_set1_epi16(128)), 8);
+    return _mm256_add_epi16(y, _mm256_set1_epi16(16));
+}
+
+__attribute__((target("avx2"))) inline __m256i average_avx2(__m256i sum_lo, __m256i sum_hi)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    __m256i lo = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(sum_lo, ones), two), 2);
+    __m256i hi = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(sum_hi, ones), two), 2);
+    return _mm256_packus_epi32(lo, hi);
+}
+
+__attribute__((target("avx2"))) inline __m256i chroma_avx2(__m256i c112, __m256i c1, __m256i k1, __m256i c2, __m256i k2)
+{
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(c112, _mm256_set1_epi16(112)), _mm256_set1_epi16((short)32896));
+    x = _mm256_sub_epi16(x, _mm256_mullo_epi16(c1, k1));
+    x = _mm256_sub_epi16(x, _mm256_mullo_epi16(c2, k2));
+    return _mm256_srli_epi16(x, 8);
+}
+
+template <bool kNV12>
+__attribute__((target("avx2"))) void rows_avx2(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                                                uint8_t *u, uint8_t *v, int width)
+{
+    // 两级 packus 之后 32 位元素（4 像素 / 2 个色度样本）的顺序为 0,2,4,6,1,3,5,7
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m256i *s0 = (const __m256i *)(src0 + (size_t)x * 4);
+        const __m256i *s1 = (const __m256i *)(src1 + (size_t)x * 4);
+        __m256i b0l, g0l, r0l, b0h, g0h, r0h, b1l, g1l, r1l, b1h, g1h, r1h;
+        split_avx2(_mm256_loadu_si256(s0), _mm256_loadu_si256(s0 + 1), b0l, g0l, r0l);
+        split_avx2(_mm256_loadu_si256(s0 + 2), _mm256_loadu_si256(s0 + 3), b0h, g0h, r0h);
+        split_avx2(_mm256_loadu_si256(s1), _mm256_loadu_si256(s1 + 1), b1l, g1l, r1l);
+        split_avx2(_mm256_loadu_si256(s1 + 2), _mm256_loadu_si256(s1 + 3), b1h, g1h, r1h);
+
+        __m256i l0 = _mm256_packus_epi16(luma_avx2(b0l, g0l, r0l), luma_avx2(b0h, g0h, r0h));
+        __m256i l1 = _mm256_packus_epi16(luma_avx2(b1l, g1l, r1l), luma_avx2(b1h, g1h, r1h));
+        _mm256_storeu_si256((__m256i *)(y0 + x), _mm256_permutevar8x32_epi32(l0, order));
+        _mm256_storeu_si256((__m256i *)(y1 + x), _mm256_permutevar8x32_epi32(l1, order));
+
+        __m256i b = average_avx2(_mm256_add_epi16(b0l, b1l), _mm256_add_epi16(b0h, b1h));
+        __m256i g = average_avx2(_mm256_add_epi16(g0l, g1l), _mm256_add_epi16(g0h, g1h));
+        __m256i r = average_avx2(_mm256_add_epi16(r0l, r1l), _mm256_add_epi16(r0h, r1h));
+        __m256i cb = _mm256_permutevar8x32_epi32(chroma_avx2(b, g, _mm256_set1_epi16(74), r, _mm256_set1_epi16(38)), order);
+        __m256i cr = _mm256_permutevar8x32_epi32(chroma_avx2(r, g, _mm256_set1_epi16(94), b, _mm256_set1_epi16(18)), order);
+        if (kNV12)
+        {
+            _mm256_storeu_si256((__m256i *)(u + x), _mm256_or_si256(cb, _mm256_slli_epi16(cr, 8)));
+        }
+        else
+        {
+            // packus 后为 [U0-7 V0-7 | U8-15 V8-15]，交换中间两个 64 位块
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(cb, cr), 0xD8);
+            _mm_storeu_si128((__m128i *)(u + x / 2), _mm256_castsi256_si128(packed));
+            _mm_storeu_si128((__m128i *)(v + x / 2), _mm256_extracti128_si256(packed, 1));
+        }
+    }
+    rows_tail<kNV12>(src0, src1, y0, y1, u, v, x, width);
+}
+
+// ---------------- AVX-512BW：每次 64 像素 ----------------
+__attribute__((target("avx512f,avx512bw"))) inline void split_avx512(__m512i p0, __m512i p1, __m512i &b, __m512i &g, __m512i &r)
+{
+    const __m512i mask = _mm512_set1_epi32(0xFF);
+    b = _mm512_packus_epi32(_mm512_and_si512(p0, mask), _mm512_and_si512(p1, mask));
+    g = _mm512_packus_epi32(_mm512_and_si512(_mm512_srli_epi32(p0, 8), mask), _mm512_and_si512(_mm512_srli_epi32(p1, 8), mask));
+    r = _mm512_packus_epi32(_mm512_and_si512(_mm512_srli_epi32(p0, 16), mask), _mm512_and_si512(_mm512_srli_epi32(p1, 16), mask));
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline __m512i luma_avx512(__m512i b, __m512i g, __m512i r)
+{
+    __m512i y = _mm512_add_epi16(_mm512_mullo_epi16(r, _mm512_set1_epi16(66)), _mm512_mullo_epi16(g, _mm512_set1_epi16(129)));
+    y = _mm512_add_epi16(y, _mm512_mullo_epi16(b, _mm512_set1_epi16(25)));
+    y = _mm512_srli_epi16(_mm512_add_epi16(y, _mm512_set1_epi16(128)), 8);
+    return _mm512_add_epi16(y, _mm512_set1_epi16(16));
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline __m512i average_avx512(__m512i sum_lo, __m512i sum_hi)
+{
+    const __m512i ones = _mm512_set1_epi16(1);
+    const __m512i two = _mm512_set1_epi32(2);
+    __m512i lo = _mm512_srli_epi32(_mm512_add_epi32(_mm512_madd_epi16(sum_lo, ones), two), 2);
+    __m512i hi = _mm512_srli_epi32(_mm512_add_epi32(_mm512_madd_epi16(sum_hi, ones), two), 2);
+    return _mm512_packus_epi32(lo, hi);
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline __m512i chroma_avx512(__m512i c112, __m512i c1, __m512i k1, __m512i c2, __m512i k2)
+{
+    __m512i x = _mm512_add_epi16(_mm512_mullo_epi16(c112, _mm512_set1_epi16(112)), _mm512_set1_epi16((short)32896));
+    x = _mm512_sub_epi16(x, _mm512_mullo_epi16(c1, k1));
+    x = _mm512_sub_epi16(x, _mm512_mullo_epi16(c2, k2));
+    return _mm512_srli_epi16(x, 8);
+}
+
+template <bool kNV12>
+__attribute__((target("avx512f,avx512bw"))) void rows_avx512(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                                                              uint8_t *u, uint8_t *v, int width)
+{
+    // 四个 128 位通道各自 packus，第 k 通道的第 j 个 32 位元素对应原序号 k + 4j
+    const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    int x = 0;
+    for (; x + 64 <= width; x += 64)
+    {
+        const __m512i *s0 = (const __m512i *)(src0 + (size_t)x * 4);
+        const __m512i *s1 = (const __m512i *)(src1 + (size_t)x * 4);
+        __m512i b0l, g0l, r0l, b0h, g0h, r0h, b1l, g1l, r1l, b1h, g1h, r1h;
+        split_avx512(_mm512_loadu_si512(s0), _mm512_loadu_si512(s0 + 1), b0l, g0l, r0l);
+        split_avx512(_mm512_loadu_si512(s0 + 2), _mm512_loadu_si512(s0 + 3), b0h, g0h, r0h);
+        split_avx512(_mm512_loadu_si512(s1), _mm512_loadu_si512(s1 + 1), b1l, g1l, r1l);
+        split_avx512(_mm512_loadu_si512(s1 + 2), _mm512_loadu_si512(s1 + 3), b1h, g1h, r1h);
+
+        __m512i l0 = _mm512_packus_epi16(luma_avx512(b0l, g0l, r0l), luma_avx512(b0h, g0h, r0h));
+        __m512i l1 = _mm512_packus_epi16(luma_avx512(b1l, g1l, r1l), luma_avx512(b1h, g1h, r1h));
+        _mm512_storeu_si512(y0 + x, _mm512_permutexvar_epi32(order, l0));
+        _mm512_storeu_si512(y1 + x, _mm512_permutexvar_epi32(order, l1));
+
+        __m512i b = average_avx512(_mm512_add_epi16(b0l, b1l), _mm512_add_epi16(b0h, b1h));
+        __m512i g = average_avx512(_mm512_add_epi16(g0l, g1l), _mm512_add_epi16(g0h, g1h));
+        __m512i r = average_avx512(_mm512_add_epi16(r0l, r1l), _mm512_add_epi16(r0h, r1h));
+        __m512i cb = _mm512_permutexvar_epi32(order, chroma_avx512(b, g, _mm512_set1_epi16(74), r, _mm512_set1_epi16(38)));
+        __m512i cr = _mm512_permutexvar_epi32(order, chroma_avx512(r, g, _mm512_set1_epi16(94), b, _mm512_set1_epi16(18)));
+        if (kNV12)
+        {
+            _mm512_storeu_si512(u + x, _mm512_or_si512(cb, _mm512_slli_epi16(cr, 8)));
+        }
+        else
+        {
+            _mm256_storeu_si256((__m256i *)(u + x / 2), _mm512_cvtepi16_epi8(cb));
+            _mm256_storeu_si256((__m256i *)(v + x / 2), _mm512_cvtepi16_epi8(cr));
+        }
+    }
+    rows_tail<kNV12>(src0, src1, y0, y1, u, v, x, width);
+}
+#endif
+}
+
+ColorConverter::ColorConverter()
+    : to_i420_(&rows_c<false>), to_nv12_(&rows_c<true>), isa_("C")
+{
+#ifdef COLOR_CONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+    {
+        to_i420_ = &rows_avx512<false>;
+        to_nv12_ = &rows_avx512<true>;
+        isa_ = "AVX-512BW";
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        to_i420_ = &rows_avx2<false>;
+        to_nv12_ = &rows_avx2<true>;
+        isa_ = "AVX2";
+    }
+    else if (__builtin_cpu_supports("sse4.1"))
+    {
+        to_i420_ = &rows_sse41<false>;
+        to_nv12_ = &rows_sse41<true>;
+        isa_ = "SSE4.1";
+    }
+#endif
+}
+
+namespace
+{
+// 与 swscale（SWS_BILINEAR）的差值上限。swscale 9.5（FFmpeg 8.0）上实测：亮度在任何内容上最多差 1（舍入不同）；
+// 色度在平缓渐变上最多差 1，但 swscale 的色度下采样滤波比 2x2 均值宽，噪声和锐利边缘上可差到近 100，
+// 所以色度只在渐变图上比较，并留 1 的余量给其他版本的舍入差异
+constexpr int kMaxLumaError = 1;
+constexpr int kMaxChromaError = 2;
+
+AVFramePtr make_test_frame(int width, int height, AVPixelFormat format)
+{
+    AVFramePtr frame = make_av_frame();
+    if (!frame)
+        return nullptr;
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    if (av_frame_get_buffer(frame.get(), 64) < 0)
+        return nullptr;
+    return frame;
+}
+
+// 随机像素（含第 4 字节），覆盖 SIMD 中间值的整个取值范围
+void fill_noise(AVFrame *frame, uint32_t seed)
+{
+    for (int y = 0; y < frame->height; y++)
+    {
+        uint8_t *row = frame->data[0] + (size_t)y * frame->linesize[0];
+        for (int x = 0; x < frame->width * 4; x++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            row[x] = (uint8_t)(seed >> 24);
+        }
+    }
+}
+
+// 三个通道分别沿水平、垂直、对角方向缓慢变化
+void fill_gradient(AVFrame *frame)
+{
+    int w = std::max(frame->width - 1, 1);
+    int h = std::max(frame->height - 1, 1);
+    for (int y = 0; y < frame->height; y++)
+    {
+        uint8_t *row = frame->data[0] + (size_t)y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x++)
+        {
+            row[x * 4 + 0] = (uint8_t)(x * 255 / w);
+            row[x * 4 + 1] = (uint8_t)((x + y) * 255 / (w + h));
+            row[x * 4 + 2] = (uint8_t)(y * 255 / h);
+            row[x * 4 + 3] = 0;
+        }
+    }
+}
+
+// 两帧亮度、色度平面的最大差值
+void max_diff(const AVFrame *a, const AVFrame *b, int *luma, int *chroma)
+{
+    int chroma_width = (a->width + 1) / 2;
+    int chroma_height = (a->height + 1) / 2;
+    bool nv12 = a->format == AV_PIX_FMT_NV12;
+
+    struct Plane
+    {
+        int index, width, height;
+        int *result;
+    };
+    const Plane planes[] = {
+        {0, a->width, a->height, luma},
+        {1, nv12 ? chroma_width * 2 : chroma_width, chroma_height, chroma},
+        {2, nv12 ? 0 : chroma_width, chroma_height, chroma},
+    };
+
+    *luma = 0;
+    *chroma = 0;
+    for (const Plane &plane : planes)
+    {
+        for (int y = 0; y < plane.height; y++)
+        {
+            const uint8_t *pa = a->data[plane.index] + (size_t)y * a->linesize[plane.index];
+            const uint8_t *pb = b->data[plane.index] + (size_t)y * b->linesize[plane.index];
+            for (int x = 0; x < plane.width; x++)
+                *plane.result = std::max(*plane.result, std::abs(pa[x] - pb[x]));
+        }
+    }
+}
+}
+
+bool ColorConverter::self_test()
+{
+    struct Kernel
+    {
+        const char *name;
+        RowsFn i420;
+        RowsFn nv12;
+    };
+    std::vector<Kernel> kernels;
+#ifdef COLOR_CONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))
+        kernels.push_back({"SSE4.1", &rows_sse41<false>, &rows_sse41<true>});
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({"AVX2", &rows_avx2<false>, &rows_avx2<true>});
+    if (__builtin_cpu_supports("avx512bw"))
+        kernels.push_back({"AVX-512BW", &rows_avx512<false>, &rows_avx512<true>});
+#endif
+
+    ColorConverter reference;
+    reference.to_i420_ = &rows_c<false>;
+    reference.to_nv12_ = &rows_c<true>;
+
+    // 宽度覆盖各 SIMD 宽度的整倍数、差一和多一，以及奇数宽高的边界配对
+    const int widths[] = {1, 2, 3, 15, 16, 17, 31, 33, 63, 64, 65, 127, 129, 257};
+    const int heights[] = {1, 2, 3, 5, 17};
+    const AVPixelFormat formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12};
+
+    bool passed = true;
+    std::string tested = "C";
+    for (const Kernel &kernel : kernels)
+        tested += std::string(", ") + kernel.name;
+
+    for (int width : widths)
+    {
+        for (int height : heights)
+        {
+            AVFramePtr src = make_test_frame(width, height, AV_PIX_FMT_BGR0);
+            if (!src)
+                return false;
+            fill_noise(src.get(), (uint32_t)(width * 131 + height));
+
+            for (AVPixelFormat format : formats)
+            {
+                AVFramePtr expected = make_test_frame(width, height, format);
+                AVFramePtr actual = make_test_frame(width, height, format);
+                if (!expected || !actual)
+                    return false;
+                reference.convert(src.get(), expected.get());
+
+                for (const Kernel &kernel : kernels)
+                {
+                    ColorConverter converter = reference;
+                    converter.to_i420_ = kernel.i420;
+                    converter.to_nv12_ = kernel.nv12;
+                    converter.convert(src.get(), actual.get());
+
+                    int luma = 0, chroma = 0;
+                    max_diff(expected.get(), actual.get(), &luma, &chroma);
+                    if (luma != 0 || chroma != 0)
+                    {
+                        std::cerr << "[ColorConverter] ERROR: " << kernel.name << " differs from C at " << width << "x"
+                                  << height << (format == AV_PIX_FMT_NV12 ? " NV12" : " I420") << " (luma "
+                                  << luma << ", chroma " << chroma << ")." << std::endl;
+                        passed = false;
+                    }
+                }
+            }
+        }
+    }
+
+    // 与 swscale 比较误差上限，尺寸取奇数：渐变图比较亮度和色度，噪声图只比较亮度
+    const int width = 257, height = 129;
+    for (int pattern = 0; pattern < 2; pattern++)
+    {
+        const bool gradient = pattern == 0;
+        AVFramePtr src = make_test_frame(width, height, AV_PIX_FMT_BGR0);
+        if (!src)
+            return false;
+        if (gradient)
+            fill_gradient(src.get());
+        else
+            fill_noise(src.get(), 1);
+
+        for (AVPixelFormat format : formats)
+        {
+            AVFramePtr ours = make_test_frame(width, height, format);
+            AVFramePtr theirs = make_test_frame(width, height, format);
+            SwsContextPtr sws(sws_getContext(width, height, AV_PIX_FMT_BGR0, width, height, format,
+                                             SWS_BILINEAR, nullptr, nullptr, nullptr));
+            if (!ours || !theirs || !sws)
+            {
+                std::cerr << "[ColorConverter] ERROR: Could not set up the swscale comparison." << std::endl;
+                return false;
+            }
+            reference.convert(src.get(), ours.get());
+            sws_scale(sws.get(), (const uint8_t *const *)src->data, src->linesize, 0, height,
+                      theirs->data, theirs->linesize);
+
+            int luma = 0, chroma = 0;
+            max_diff(ours.get(), theirs.get(), &luma, &chroma);
+            std::string name = std::string(format == AV_PIX_FMT_NV12 ? "NV12" : "I420") + (gradient ? " gradient" : " noise");
+            if (luma > kMaxLumaError || (gradient && chroma > kMaxChromaError))
+            {
+                std::cerr << "[ColorConverter] ERROR: " << name << " differs from swscale by luma " << luma
+                          << ", chroma " << chroma << " (limit " << kMaxLumaError << "/" << kMaxChromaError << ")." << std::endl;
+                passed = false;
+            }
+            else
+            {
+                std::cout << "[ColorConverter] " << name << " vs swscale: max error luma " << luma << ", chroma "
+                          << chroma << (gradient ? "." : " (not checked).") << std::endl;
+            }
+        }
+    }
+
+    std::cout << "[ColorConverter] Self-test " << (passed ? "passed" : "FAILED") << " (" << tested << ")." << std::endl;
+    return passed;
+}
+
+bool ColorConverter::supports(int src_format, int dst_format)
+{
+    return (src_format == AV_PIX_FMT_BGR0 || src_format == AV_PIX_FMT_BGRA) &&
+           (dst_format == AV_PIX_FMT_YUV420P || dst_format == AV_PIX_FMT_NV12);
+}
+
+bool ColorConverter::convert(const AVFrame *src, AVFrame *dst) const
+{
+    if (!supports(src->format, dst->format) || src->width != dst->width || src->height != dst->height)
+        return false;
+    convert_rows(src, dst, 0, src->height);
+    return true;
+}
+
+void ColorConverter::convert_rows(const AVFrame *src, AVFrame *dst, int row_begin, int row_end) const
+{
+    const bool nv12 = dst->format == AV_PIX_FMT_NV12;
+    RowsFn rows = nv12 ? to_nv12_ : to_i420_;
+    for (int y = row_begin; y < row_end; y += 2)
+    {
+        int y_next = std::min(y + 1, src->height - 1); // 奇数高度时最后一行与自身配对
+        rows(src->data[0] + (size_t)y * src->linesize[0],
+             src->data[0] + (size_t)y_next * src->linesize[0],
+             dst->data[0] + (size_t)y * dst->linesize[0],
+             dst->data[0] + (size_t)y_next * dst->linesize[0],
+             dst->data[1] + (size_t)(y / 2) * dst->linesize[1],
+             nv12 ? nullptr : dst->data[2] + (size_t)(y / 2) * dst->linesize[2],
+             src->width);
+    }
+}
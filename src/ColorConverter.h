@@ -0,0 +1,40 @@
+#pragma once
+
+#include "FFMpegWrappers.h"
+#include <cstdint>
+
+// BGR0/BGRA → YUV 4:2:0（I420 或 NV12）专用像素格式转换
+// 输入输出尺寸相同时只做格式转换，不需要 sws_scale 的缩放滤波。
+// 按 BT.601 limited range 定点计算，色度取 2x2 像素均值；
+// 运行时根据 CPU 选择 AVX-512BW / AVX2 / SSE4.1 / 标量实现，各实现输出逐位一致。
+class ColorConverter
+{
+public:
+    ColorConverter();
+
+    // 是否支持该源/目标像素格式组合
+    static bool supports(int src_format, int dst_format);
+
+    // 转换整帧，src 与 dst 尺寸须相同
+    bool convert(const AVFrame *src, AVFrame *dst) const;
+
+    // 只转换 [row_begin, row_end) 行，row_begin 须为偶数，可用于多线程分片
+    void convert_rows(const AVFrame *src, AVFrame *dst, int row_begin, int row_end) const;
+
+    // 当前使用的指令集名称
+    const char *isa() const { return isa_; }
+
+    // 自检：当前 CPU 支持的每个 SIMD 实现在各种奇数宽高下须与标量实现逐位一致，
+    // 标量实现与 swscale（SWS_BILINEAR，即 Converter 的回退路径）的差值不得超过上限。
+    // 结果打印到标准输出/错误，返回是否通过
+    static bool self_test();
+
+private:
+    // 一次处理相邻两行：输出两行亮度和一行色度（NV12 时 u 指向交错的 UV 平面，v 不使用）
+    using RowsFn = void (*)(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                            uint8_t *u, uint8_t *v, int width);
+
+    RowsFn to_i420_;
+    RowsFn to_nv12_;
+    const char *isa_;
+};
@@ -0,0 +1,236 @@
+#include "Converter.h"
+#include <iostream>
+#include <algorithm>
+
+Converter::Converter(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> raw_q,
+                     std::shared_ptr<ThreadSafeQueue<AVFramePtr>> converted_q)
+    : raw_frame_queue_(raw_q), converted_frame_queue_(converted_q) {}
+
+Converter::~Converter()
+{
+    stop();
+}
+
+bool Converter::start(int width, int height, AVPixelFormat format, int num_threads)
+{
+    width_ = width;
+    height_ = height;
+    format_ = format;
+
+    if (!output_pool_.init(width, height, format, kOutputFrames))
+    {
+        std::cerr << "[Converter] ERROR: Could not create output frame pool." << std::endl;
+        return false;
+    }
+
+    if (self_test_ && !ColorConverter::self_test())
+    {
+        std::cerr << "[Converter] WARNING: Color conversion self-test failed, falling back to swscale." << std::endl;
+        use_color_converter_ = false;
+    }
+
+    // 条带高度取偶数，保证每个条带的色度行完整
+    num_slices_ = std::max(1, std::min(num_threads, height / 2));
+    slice_rows_ = ((height + num_slices_ - 1) / num_slices_ + 1) & ~1;
+
+    workers_stop_ = false;
+    for (int i = 1; i < num_slices_; i++)
+    {
+        workers_.emplace_back(&Converter::worker_loop, this);
+    }
+
+    std::cout << "[Converter] Started with " << num_slices_ << " threads, color conversion: "
+              << (use_color_converter_ ? color_converter_.isa() : "swscale") << "." << std::endl;
+    return true;
+}
+
+void Converter::stop()
+{
+    stop_flag_ = true;
+    raw_frame_queue_->stop();       // 通知上游队列停止
+    converted_frame_queue_->stop(); // 通知下游队列停止
+    stop_workers();
+}
+
+void Converter::stop_workers()
+{
+    {
+        std::lock_guard<std::mutex> lock(job_mutex_);
+        workers_stop_ = true;
+    }
+    job_cv_.notify_all();
+    for (auto &worker : workers_)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+    workers_.clear();
+}
+
+void Converter::run()
+{
+    AVFramePtr raw_frame;
+    frame_count_ = 0; // 重置帧计数器
+    skipped_frames_ = 0;
+    dropped_frames_ = 0;
+    static_detector_.reset();
+
+    while (!stop_flag_)
+    {
+        if (!raw_frame_queue_->wait_and_pop(raw_frame))
+        {
+            if (stop_flag_)
+            {
+                break; // 收到停止信号且队列已空，退出循环
+            }
+            continue;
+        }
+
+        if (!raw_frame)
+            continue;
+
+        // 静态帧检测：画面未变化、未到保活时间且未被要求输出时，跳过格式转换和编码
+        bool forced = force_output_ && force_output_();
+        if (keepalive_interval_ms_ > 0)
+        {
+            auto now = std::chrono::steady_clock::now();
+            bool changed = static_detector_.update(raw_frame.get());
+            bool keepalive_due = now - last_output_time_ >= std::chrono::milliseconds(keepalive_interval_ms_);
+            if (!changed && !keepalive_due && !forced)
+            {
+                frame_count_++; // PTS 继续按采集帧推进，保持时间轴连续
+                skipped_frames_++;
+                continue;
+            }
+        }
+
+        auto frame = output_pool_.acquire();
+        if (!frame)
+        {
+            // 编码器积压，丢弃本帧；检测器已记下本帧内容，必须重置，否则后续帧的变化会被误判为静止
+            static_detector_.reset();
+            frame_count_++;
+            dropped_frames_++;
+            continue;
+        }
+
+        // 同尺寸的 BGR0/BGRA → YUV 只是像素格式转换，分条带并行处理
+        if (use_color_converter_ && ColorConverter::supports(raw_frame->format, format_) &&
+            raw_frame->width == width_ && raw_frame->height == height_)
+        {
+            convert_sliced(raw_frame.get(), frame.get());
+        }
+        else if (!convert_with_sws(raw_frame.get(), frame.get()))
+        {
+            break; // 无法转换，退出
+        }
+
+        // 使用简单的帧计数作为 PTS，基于编码器的时间基
+        frame->pts = frame_count_++;
+        last_output_time_ = std::chrono::steady_clock::now();
+        converted_frame_queue_->push(std::move(frame));
+    }
+
+    std::cout << "[Converter] Thread finished, skipped " << skipped_frames_ << " static frames, dropped "
+              << dropped_frames_ << " frames." << std::endl;
+}
+
+void Converter::convert_sliced(const AVFrame *src, AVFrame *dst)
+{
+    if (num_slices_ == 1)
+    {
+        color_converter_.convert_rows(src, dst, 0, src->height);
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(job_mutex_);
+        // 上一帧迟到的工作线程可能还持有旧任务，必须等它们全部退出才能发布新任务
+        done_cv_.wait(lock, [this]
+                      { return active_workers_ == 0; });
+        job_src_ = src;
+        job_dst_ = dst;
+        pending_slices_ = num_slices_;
+        next_slice_ = 0;
+        job_id_++;
+    }
+    job_cv_.notify_all();
+
+    // 当前线程也参与处理，避免空等
+    process_slices(src, dst);
+
+    std::unique_lock<std::mutex> lock(job_mutex_);
+    done_cv_.wait(lock, [this]
+                  { return pending_slices_ == 0; });
+}
+
+void Converter::process_slices(const AVFrame *src, AVFrame *dst)
+{
+    while (true)
+    {
+        int slice = next_slice_.fetch_add(1);
+        if (slice >= num_slices_)
+            break;
+
+        int row_begin = slice * slice_rows_;
+        int row_end = std::min(src->height, row_begin + slice_rows_);
+        if (row_begin < row_end)
+        {
+            color_converter_.convert_rows(src, dst, row_begin, row_end);
+        }
+
+        if (pending_slices_.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(job_mutex_);
+            done_cv_.notify_all();
+        }
+    }
+}
+
+void Converter::worker_loop()
+{
+    uint64_t seen_job = 0;
+    std::unique_lock<std::mutex> lock(job_mutex_);
+    while (true)
+    {
+        job_cv_.wait(lock, [&]
+                     { return workers_stop_ || job_id_ != seen_job; });
+        if (workers_stop_)
+            break;
+
+        seen_job = job_id_;
+        const AVFrame *src = job_src_;
+        AVFrame *dst = job_dst_;
+        active_workers_++;
+        lock.unlock();
+
+        process_slices(src, dst);
+
+        lock.lock();
+        if (--active_workers_ == 0)
+        {
+            done_cv_.notify_all();
+        }
+    }
+}
+
+bool Converter::convert_with_sws(const AVFrame *src, AVFrame *dst)
+{
+    // 惰性初始化 SwsContext
+    if (!sws_ctx_)
+    {
+        sws_ctx_.reset(sws_getContext(src->width, src->height, (AVPixelFormat)src->format,
+                                      width_, height_, format_,
+                                      SWS_BILINEAR, nullptr, nullptr, nullptr));
+        if (!sws_ctx_)
+        {
+            std::cerr << "[Converter] ERROR: Failed to create SwsContext." << std::endl;
+            return false;
+        }
+    }
+
+    // 执行像素格式转换
+    sws_scale(sws_ctx_.get(), (const uint8_t *const *)src->data, src->linesize, 0, src->height,
+              dst->data, dst->linesize);
+    return true;
+}
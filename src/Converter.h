@@ -0,0 +1,85 @@
+#pragma once
+
+#include "FFMpegWrappers.h"
+#include "ThreadSafeQueue.h"
+#include "StaticFrameDetector.h"
+#include "ColorConverter.h"
+#include "FramePool.h"
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <functional>
+
+// 像素格式转换阶段：位于采集与编码之间，独立线程运行
+// 每帧按水平条带切分，由工作线程池并行转换，结果帧取自 FramePool，经自己的队列交给编码器。
+// 静态帧检测也在这一阶段完成，静止画面不做转换也不送编码。
+class Converter
+{
+public:
+    Converter(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> raw_q,
+              std::shared_ptr<ThreadSafeQueue<AVFramePtr>> converted_q);
+    ~Converter();
+
+    // num_threads 为参与转换的线程总数（含 run() 所在线程）
+    bool start(int width, int height, AVPixelFormat format, int num_threads);
+    void stop();
+    void run();
+
+    // 画面静止时跳过转换和编码，但每隔 interval_ms 仍输出一帧保活；0 表示关闭静态帧跳过
+    void set_keepalive_interval(int interval_ms) { keepalive_interval_ms_ = interval_ms; }
+
+    // predicate 返回 true 时，当前帧即使静止也输出（例如编码器有待满足的关键帧请求）
+    // 需在 run() 之前设置
+    void set_force_output(std::function<bool()> predicate) { force_output_ = std::move(predicate); }
+
+    // 调试用：start() 时运行 ColorConverter::self_test()，失败则改用 swscale；需在 start() 之前设置
+    void set_self_test(bool enabled) { self_test_ = enabled; }
+
+private:
+    void convert_sliced(const AVFrame *src, AVFrame *dst);
+    void stop_workers();
+    void process_slices(const AVFrame *src, AVFrame *dst);
+    void worker_loop();
+    bool convert_with_sws(const AVFrame *src, AVFrame *dst);
+
+    std::shared_ptr<ThreadSafeQueue<AVFramePtr>> raw_frame_queue_;
+    std::shared_ptr<ThreadSafeQueue<AVFramePtr>> converted_frame_queue_;
+    std::atomic_bool stop_flag_{false};
+    std::function<bool()> force_output_;
+
+    int width_ = 0;
+    int height_ = 0;
+    AVPixelFormat format_ = AV_PIX_FMT_NONE;
+    ColorConverter color_converter_;
+    bool self_test_ = false;
+    bool use_color_converter_ = true; // 自检失败时为 false
+    SwsContextPtr sws_ctx_ = nullptr; // 仅在专用转换不支持输入格式或尺寸时使用
+    FramePool output_pool_;
+    long frame_count_ = 0; // 用于设置 PTS
+
+    StaticFrameDetector static_detector_;
+    int keepalive_interval_ms_ = 1000;
+    std::chrono::steady_clock::time_point last_output_time_;
+    long skipped_frames_ = 0;
+    long dropped_frames_ = 0;
+
+    static const int kOutputFrames = 4; // 输出帧池容量，编码器积压超过这个数量时丢帧
+
+    // 条带任务：run() 线程发布任务后自己也参与处理，等全部条带完成再继续
+    std::vector<std::thread> workers_;
+    std::mutex job_mutex_;
+    std::condition_variable job_cv_;
+    std::condition_variable done_cv_;
+    bool workers_stop_ = false;
+    int active_workers_ = 0; // 正在处理条带的工作线程数，受 job_mutex_ 保护
+    uint64_t job_id_ = 0;
+    const AVFrame *job_src_ = nullptr;
+    AVFrame *job_dst_ = nullptr;
+    int num_slices_ = 1;
+    int slice_rows_ = 0;
+    std::atomic_int next_slice_{0};
+    std::atomic_int pending_slices_{0};
+};
@@ -1,9 +1,9 @@
 #include "Encoder.h"
 #include <iostream>
 
-Encoder::Encoder(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> raw_q,
+Encoder::Encoder(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> converted_q,
                  std::shared_ptr<ThreadSafeQueue<AVPacketPtr>> encoded_q)
-    : raw_frame_queue_(raw_q), encoded_packet_queue_(encoded_q) {}
+    : converted_frame_queue_(converted_q), encoded_packet_queue_(encoded_q) {}
 
 Encoder::~Encoder()
 {
@@ -41,6 +41,8 @@ bool Encoder::start(int width, int height)
     // 设置编码速度和延迟优化选项
     av_opt_set(enc_ctx_->priv_data, "preset", "ultrafast", 0);
     av_opt_set(enc_ctx_->priv_data, "tune", "zerolatency", 0);
+    // 强制 I 帧时输出 IDR，使新加入的客户端能从该帧开始解码
+    av_opt_set(enc_ctx_->priv_data, "forced-idr", "1", 0);
 
     // 打开编码器
     if (avcodec_open2(enc_ctx_.get(), codec, nullptr) < 0)
@@ -49,23 +51,6 @@ bool Encoder::start(int width, int height)
         return false;
     }
 
-    // 准备用于格式转换的目标帧
-    scaled_frame_ = make_av_frame();
-    if (!scaled_frame_)
-    {
-        std::cerr << "[Encoder] ERROR: Could not allocate scaled frame." << std::endl;
-        return false;
-    }
-    scaled_frame_->width = width;
-    scaled_frame_->height = height;
-    scaled_frame_->format = enc_ctx_->pix_fmt;
-    // 为 scaled_frame 分配 buffer
-    if (av_frame_get_buffer(scaled_frame_.get(), 0) < 0)
-    {
-        std::cerr << "[Encoder] ERROR: Could not allocate buffer for scaled frame." << std::endl;
-        return false;
-    }
-
     std::cout << "[Encoder] Started successfully with libx264." << std::endl;
     return true;
 }
@@ -73,20 +58,27 @@ bool Encoder::start(int width, int height)
 void Encoder::stop()
 {
     stop_flag_ = true;
-    raw_frame_queue_->stop();      // 通知上游队列停止
+    converted_frame_queue_->stop(); // 通知上游队列停止
     encoded_packet_queue_->stop(); // 通知下游队列停止
 }
 
+void Encoder::request_keyframe()
+{
+    keyframe_requests_++;
+    keyframe_requested_ = true;
+}
+
 void Encoder::run()
 {
-    AVFramePtr raw_frame;
+    AVFramePtr frame;
     auto packet = make_av_packet();
     frame_count_ = 0; // 重置帧计数器
+    forced_keyframes_ = 0;
 
     while (!stop_flag_)
     {
-        // 从原始帧队列中等待并获取数据
-        if (!raw_frame_queue_->wait_and_pop(raw_frame))
+        // 从转换后的帧队列中等待并获取数据
+        if (!converted_frame_queue_->wait_and_pop(frame))
         {
             // 如果返回 false，检查是否是停止信号
             if (stop_flag_)
@@ -96,32 +88,32 @@ void Encoder::run()
             continue; // 队列暂时为空，继续等待
         }
 
-        if (!raw_frame)
+        if (!frame)
             continue; // 以防万一弹出的是空指针
 
-        // 惰性初始化 SwsContext
-        if (!sws_ctx_)
+        // PTS 由转换阶段按采集帧序号设置（跳过的静态帧也计入）
+        if (frame->pts == AV_NOPTS_VALUE)
         {
-            sws_ctx_.reset(sws_getContext(raw_frame->width, raw_frame->height, (AVPixelFormat)raw_frame->format,
-                                          enc_ctx_->width, enc_ctx_->height, enc_ctx_->pix_fmt,
-                                          SWS_BILINEAR, nullptr, nullptr, nullptr));
-            if (!sws_ctx_)
+            frame->pts = frame_count_;
+        }
+        frame_count_ = frame->pts + 1;
+
+        // 有待满足的关键帧请求且距上次强制 IDR 已足够久时，本帧编码为 IDR；否则请求保留到下一帧
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        if (keyframe_requested_)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_forced_keyframe_ >= std::chrono::milliseconds(kMinKeyframeIntervalMs))
             {
-                std::cerr << "[Encoder] ERROR: Failed to create SwsContext." << std::endl;
-                break; // 无法转换，退出
+                keyframe_requested_ = false;
+                last_forced_keyframe_ = now;
+                forced_keyframes_++;
+                frame->pict_type = AV_PICTURE_TYPE_I;
             }
         }
 
-        // 执行像素格式转换
-        sws_scale(sws_ctx_.get(), (const uint8_t *const *)raw_frame->data, raw_frame->linesize, 0, raw_frame->height,
-                  scaled_frame_->data, scaled_frame_->linesize);
-
-        // 设置 scaled_frame 的 PTS (Presentation Timestamp)
-        // 使用简单的帧计数作为 PTS，基于编码器的时间基
-        scaled_frame_->pts = frame_count_++;
-
         // 将转换后的帧发送给编码器
-        int ret = avcodec_send_frame(enc_ctx_.get(), scaled_frame_.get());
+        int ret = avcodec_send_frame(enc_ctx_.get(), frame.get());
         if (ret == 0)
         {
             // 循环接收编码后的数据包
@@ -175,5 +167,6 @@ void Encoder::run()
         encoded_packet_queue_->push(std::move(packet_to_push));
     }
 
-    std::cout << "[Encoder] Thread finished." << std::endl;
+    std::cout << "[Encoder] Thread finished, forced " << forced_keyframes_ << " IDR frames for "
+              << keyframe_requests_ << " requests." << std::endl;
 }
\ No newline at end of file
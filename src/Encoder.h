@@ -4,11 +4,13 @@
 #include "ThreadSafeQueue.h"
 #include <thread>
 #include <atomic>
+#include <chrono>
 
 class Encoder
 {
 public:
-    Encoder(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> raw_q,
+    // 输入为 Converter 输出的、已是编码器像素格式的帧
+    Encoder(std::shared_ptr<ThreadSafeQueue<AVFramePtr>> converted_q,
             std::shared_ptr<ThreadSafeQueue<AVPacketPtr>> encoded_q);
     ~Encoder();
 
@@ -18,13 +20,25 @@ public:
 
     AVCodecContext *get_codec_context() { return enc_ctx_.get(); }
 
+    // 请求尽快输出一个 IDR 帧（可从任意线程调用）
+    // 尚未满足的多次请求合并为一次；强制 IDR 之间至少间隔 kMinKeyframeIntervalMs，
+    // 一批客户端同时加入时不会引起一串 IDR
+    void request_keyframe();
+
+    // 是否有尚未满足的关键帧请求
+    bool keyframe_pending() const { return keyframe_requested_; }
+
 private:
-    std::shared_ptr<ThreadSafeQueue<AVFramePtr>> raw_frame_queue_;
+    std::shared_ptr<ThreadSafeQueue<AVFramePtr>> converted_frame_queue_;
     std::shared_ptr<ThreadSafeQueue<AVPacketPtr>> encoded_packet_queue_;
     std::atomic_bool stop_flag_{false};
+    std::atomic_bool keyframe_requested_{false};
 
     AVCodecContextPtr enc_ctx_ = nullptr;
-    SwsContextPtr sws_ctx_ = nullptr;
-    AVFramePtr scaled_frame_ = nullptr;
-    long frame_count_ = 0; // 用于设置 PTS
+    long frame_count_ = 0; // 输入帧未携带 PTS 时用于设置 PTS
+
+    std::chrono::steady_clock::time_point last_forced_keyframe_;
+    std::atomic_long keyframe_requests_{0};
+    long forced_keyframes_ = 0;
+    static const int kMinKeyframeIntervalMs = 500;
 };
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+#include <cstring>
 
 extern "C"
 {
@@ -8,6 +10,7 @@ extern "C"
 #include <libavcodec/avcodec.h>
 #include <libavutil/frame.h>
 #include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 }
 
@@ -79,6 +82,17 @@ struct SwsContextDeleter
 };
 using SwsContextPtr = std::unique_ptr<SwsContext, SwsContextDeleter>;
 
+// 为 AVBufferPool 自定义 Deleter
+// uninit 后池会等到所有已借出的缓冲都归还才真正释放
+struct AVBufferPoolDeleter
+{
+    void operator()(AVBufferPool *ptr) const
+    {
+        av_buffer_pool_uninit(&ptr);
+    }
+};
+using AVBufferPoolPtr = std::unique_ptr<AVBufferPool, AVBufferPoolDeleter>;
+
 // 创建智能指针的工厂函数
 inline AVFramePtr make_av_frame()
 {
@@ -88,4 +102,70 @@ inline AVFramePtr make_av_frame()
 inline AVPacketPtr make_av_packet()
 {
     return AVPacketPtr(av_packet_alloc());
-}
\ No newline at end of file
+}
+
+// 从缓冲池取一块内存构造帧；AVFramePtr 的 Deleter 执行时缓冲自动归还到池中
+// 池中每块缓冲的大小需不小于 av_image_get_buffer_size(format, width, height, align)
+inline AVFramePtr make_pooled_av_frame(AVBufferPool *pool, int width, int height, AVPixelFormat format, int align = 64)
+{
+    AVBufferRef *buf = av_buffer_pool_get(pool);
+    if (!buf)
+        return nullptr;
+
+    AVFramePtr frame = make_av_frame();
+    if (!frame)
+    {
+        av_buffer_unref(&buf);
+        return nullptr;
+    }
+    frame->buf[0] = buf;
+
+    int size = av_image_fill_arrays(frame->data, frame->linesize, buf->data, format, width, height, align);
+    if (size < 0 || (size_t)size > buf->size)
+        return nullptr;
+
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    return frame;
+}
+
+// 帧的脏矩形（屏幕坐标，单位为像素）
+struct DirtyRect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// 脏矩形列表通过 AVFrame::opaque_ref 随帧传递，布局为 [uint32_t count][DirtyRect * count]
+// 空列表表示画面与上一帧相同；没有附加信息的帧视为整帧都可能变化
+inline bool set_frame_dirty_rects(AVFrame *frame, const std::vector<DirtyRect> &rects)
+{
+    av_buffer_unref(&frame->opaque_ref);
+    frame->opaque_ref = av_buffer_alloc(sizeof(uint32_t) + rects.size() * sizeof(DirtyRect));
+    if (!frame->opaque_ref)
+        return false;
+    uint32_t count = (uint32_t)rects.size();
+    memcpy(frame->opaque_ref->data, &count, sizeof(count));
+    if (count > 0)
+        memcpy(frame->opaque_ref->data + sizeof(uint32_t), rects.data(), rects.size() * sizeof(DirtyRect));
+    return true;
+}
+
+// 返回 false 表示该帧没有脏矩形信息
+inline bool get_frame_dirty_rects(const AVFrame *frame, std::vector<DirtyRect> &rects)
+{
+    rects.clear();
+    if (!frame->opaque_ref || frame->opaque_ref->size < sizeof(uint32_t))
+        return false;
+    uint32_t count = 0;
+    memcpy(&count, frame->opaque_ref->data, sizeof(count));
+    if (frame->opaque_ref->size < sizeof(uint32_t) + count * sizeof(DirtyRect))
+        return false;
+    rects.resize(count);
+    if (count > 0)
+        memcpy(rects.data(), frame->opaque_ref->data + sizeof(uint32_t), count * sizeof(DirtyRect));
+    return true;
+}
@@ -0,0 +1,150 @@
+#include "FramePool.h"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+FramePool::FramePool() {}
+
+FramePool::~FramePool() {}
+
+bool FramePool::init(int width, int height, AVPixelFormat format, int capacity, HugePageMode mode)
+{
+    int buffer_size = av_image_get_buffer_size(format, width, height, kAlign);
+    if (buffer_size <= 0 || capacity <= 0)
+    {
+        std::cerr << "[FramePool] ERROR: Invalid frame geometry or capacity." << std::endl;
+        return false;
+    }
+
+    auto state = new State();
+    state->mode = mode;
+    state->buffer_size = buffer_size;
+    state->capacity = capacity;
+    // 大页模式下按 2MB 向上取整，保证每块缓冲都由完整的大页组成
+    state->mapping_size = mode == HugePageMode::None
+                              ? (size_t)buffer_size
+                              : (buffer_size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+
+    pool_.reset(av_buffer_pool_init2(buffer_size, state, &FramePool::alloc_buffer, &FramePool::free_state));
+    if (!pool_)
+    {
+        delete state;
+        std::cerr << "[FramePool] ERROR: Failed to create buffer pool." << std::endl;
+        return false;
+    }
+
+    width_ = width;
+    height_ = height;
+    format_ = format;
+    capacity_ = capacity;
+
+    // 预先分配全部缓冲并归还到池中，运行期不再触发分配
+    std::vector<AVBufferRef *> buffers;
+    for (int i = 0; i < capacity; i++)
+    {
+        AVBufferRef *buf = av_buffer_pool_get(pool_.get());
+        if (!buf)
+            break;
+        buffers.push_back(buf);
+    }
+    bool ok = (int)buffers.size() == capacity;
+    for (auto &buf : buffers)
+    {
+        av_buffer_unref(&buf);
+    }
+    if (!ok)
+    {
+        std::cerr << "[FramePool] ERROR: Could only preallocate " << buffers.size() << " of " << capacity << " buffers." << std::endl;
+        pool_.reset();
+        return false;
+    }
+
+    const char *mode_name = state->mode == HugePageMode::Explicit      ? "hugetlb"
+                            : state->mode == HugePageMode::Transparent ? "transparent hugepages"
+                                                                       : "normal pages";
+    std::cout << "[FramePool] Preallocated " << capacity << " x " << buffer_size << " bytes (" << mode_name << ")." << std::endl;
+    return true;
+}
+
+AVFramePtr FramePool::acquire()
+{
+    if (!pool_)
+        return nullptr;
+    return make_pooled_av_frame(pool_.get(), width_, height_, format_, kAlign);
+}
+
+AVBufferRef *FramePool::alloc_buffer(void *opaque, size_t size)
+{
+    State *state = static_cast<State *>(opaque);
+    // 容量固定：超出时让 av_buffer_pool_get 返回 NULL，由调用方丢帧
+    if (state->allocated.fetch_add(1) >= state->capacity)
+    {
+        state->allocated--;
+        return nullptr;
+    }
+
+    void *data = nullptr;
+    if (state->mode == HugePageMode::Explicit)
+    {
+        data = mmap(nullptr, state->mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            data = nullptr;
+            // 首块缓冲就失败说明没有预留大页，整个池退回透明大页
+            if (state->allocated == 1)
+            {
+                std::cerr << "[FramePool] WARNING: MAP_HUGETLB failed, falling back to transparent hugepages." << std::endl;
+                state->mode = HugePageMode::Transparent;
+            }
+        }
+    }
+    if (state->mode != HugePageMode::Explicit)
+    {
+        size_t alignment = state->mode == HugePageMode::Transparent ? kHugePageSize : kAlign;
+        if (posix_memalign(&data, alignment, state->mapping_size) != 0)
+        {
+            data = nullptr;
+        }
+        else if (state->mode == HugePageMode::Transparent)
+        {
+            madvise(data, state->mapping_size, MADV_HUGEPAGE);
+        }
+    }
+    if (!data)
+    {
+        state->allocated--;
+        return nullptr;
+    }
+
+    // 预先触碰所有页，避免运行期缺页
+    memset(data, 0, state->mapping_size);
+
+    AVBufferRef *buf = av_buffer_create((uint8_t *)data, size, &FramePool::free_buffer, state, 0);
+    if (!buf)
+    {
+        free_buffer(state, (uint8_t *)data);
+        return nullptr;
+    }
+    return buf;
+}
+
+void FramePool::free_buffer(void *opaque, uint8_t *data)
+{
+    State *state = static_cast<State *>(opaque);
+    if (state->mode == HugePageMode::Explicit)
+    {
+        munmap(data, state->mapping_size);
+    }
+    else
+    {
+        free(data);
+    }
+    state->allocated--;
+}
+
+void FramePool::free_state(void *opaque)
+{
+    delete static_cast<State *>(opaque);
+}
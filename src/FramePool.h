@@ -0,0 +1,57 @@
+#pragma once
+
+#include "FFMpegWrappers.h"
+#include <atomic>
+#include <cstddef>
+
+// 大页使用方式
+enum class HugePageMode
+{
+    None,        // 普通页，64 字节对齐
+    Transparent, // 2MB 对齐 + madvise(MADV_HUGEPAGE)，由内核透明大页合并
+    Explicit,    // mmap(MAP_HUGETLB)，需预留 hugetlbfs 页；失败时退回 Transparent
+};
+
+// 固定容量的帧缓冲池
+// 初始化时一次性分配并预先触碰全部缓冲，之后帧在 采集→编码 之间循环使用，
+// 运行期间不再有 malloc/munmap。AVFramePtr 释放时缓冲自动归还。
+class FramePool
+{
+public:
+    FramePool();
+    ~FramePool();
+
+    bool init(int width, int height, AVPixelFormat format, int capacity,
+              HugePageMode mode = HugePageMode::Transparent);
+
+    // 取一帧；容量耗尽（下游仍持有全部缓冲）时返回 nullptr
+    AVFramePtr acquire();
+
+    int capacity() const { return capacity_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+    // 分配状态由池本身持有，池在最后一块缓冲归还后才会析构，因此不能放在 FramePool 中
+    struct State
+    {
+        HugePageMode mode = HugePageMode::None;
+        size_t buffer_size = 0;
+        size_t mapping_size = 0;
+        int capacity = 0;
+        std::atomic_int allocated{0};
+    };
+
+    static AVBufferRef *alloc_buffer(void *opaque, size_t size);
+    static void free_buffer(void *opaque, uint8_t *data);
+    static void free_state(void *opaque);
+
+    AVBufferPoolPtr pool_;
+    int width_ = 0;
+    int height_ = 0;
+    AVPixelFormat format_ = AV_PIX_FMT_NONE;
+    int capacity_ = 0;
+
+    static const int kAlign = 64;
+    static const size_t kHugePageSize = 2 * 1024 * 1024;
+};
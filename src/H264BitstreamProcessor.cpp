@@ -0,0 +1,183 @@
+#include "H264BitstreamProcessor.h"
+#include "xop/H264Parser.h"
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+constexpr uint8_t kNalIdr = 5;
+constexpr uint8_t kNalSps = 7;
+constexpr uint8_t kNalPps = 8;
+constexpr uint8_t kNalAud = 9;
+constexpr uint8_t kNalFiller = 12;
+constexpr uint8_t kStartCode[4] = {0, 0, 0, 1};
+
+uint8_t nal_type(const uint8_t *nal)
+{
+    return nal[0] & 0x1f;
+}
+}
+
+void H264BitstreamProcessor::set_extradata(const uint8_t *data, int size)
+{
+    if (!data || size <= 0)
+        return;
+
+    // avcC 以 configurationVersion = 1 开头，Annex-B 以起始码开头
+    if (data[0] == 1)
+    {
+        if (!parse_avcc(data, size))
+        {
+            std::cerr << "[Bitstream] WARNING: Could not parse avcC extradata." << std::endl;
+        }
+        return;
+    }
+
+    const uint8_t *pos = data;
+    const uint8_t *end = data + size;
+    const uint8_t *nal = nullptr;
+    uint32_t nal_size = 0;
+    while (xop::H264Parser::nextNal(&pos, end, &nal, &nal_size))
+    {
+        if (nal_type(nal) == kNalSps)
+            update_parameter_set(sps_, nal, nal_size);
+        else if (nal_type(nal) == kNalPps)
+            update_parameter_set(pps_, nal, nal_size);
+    }
+}
+
+bool H264BitstreamProcessor::parse_avcc(const uint8_t *data, int size)
+{
+    // 版本(1) profile(1) compat(1) level(1) lengthSizeMinusOne(1) numSPS(1) [len(2) sps]... numPPS(1) [len(2) pps]...
+    if (size < 7)
+        return false;
+
+    int offset = 5;
+    for (int set = 0; set < 2; set++)
+    {
+        if (offset >= size)
+            return false;
+        int count = (set == 0) ? (data[offset] & 0x1f) : data[offset];
+        offset++;
+        for (int i = 0; i < count; i++)
+        {
+            if (offset + 2 > size)
+                return false;
+            int len = (data[offset] << 8) | data[offset + 1];
+            offset += 2;
+            if (len == 0 || offset + len > size)
+                return false;
+            // 只保留第一个参数集，与 SDP 中 sprop-parameter-sets 的用法一致
+            if (i == 0)
+                update_parameter_set(set == 0 ? sps_ : pps_, data + offset, len);
+            offset += len;
+        }
+    }
+    return true;
+}
+
+void H264BitstreamProcessor::update_parameter_set(std::vector<uint8_t> &dst, const uint8_t *nal, uint32_t size)
+{
+    if (dst.size() == size && memcmp(dst.data(), nal, size) == 0)
+        return;
+
+    dst.assign(nal, nal + size);
+    parameters_changed_ = true;
+}
+
+bool H264BitstreamProcessor::take_parameter_sets(std::vector<uint8_t> &sps, std::vector<uint8_t> &pps)
+{
+    if (!parameters_changed_ || sps_.empty() || pps_.empty())
+        return false;
+
+    parameters_changed_ = false;
+    sps = sps_;
+    pps = pps_;
+    return true;
+}
+
+bool H264BitstreamProcessor::process(AVPacketPtr &packet)
+{
+    const uint8_t *pos = packet->data;
+    const uint8_t *end = packet->data + packet->size;
+    const uint8_t *nal = nullptr;
+    uint32_t nal_size = 0;
+
+    bool has_sps = false;
+    bool has_pps = false;
+    bool has_idr = false;
+    bool stripped = false;
+    nals_.clear();
+
+    while (xop::H264Parser::nextNal(&pos, end, &nal, &nal_size))
+    {
+        switch (nal_type(nal))
+        {
+        case kNalAud:
+        case kNalFiller:
+            stripped_bytes_ += nal_size;
+            stripped = true;
+            continue;
+        case kNalSps:
+            has_sps = true;
+            update_parameter_set(sps_, nal, nal_size);
+            break;
+        case kNalPps:
+            has_pps = true;
+            update_parameter_set(pps_, nal, nal_size);
+            break;
+        case kNalIdr:
+            has_idr = true;
+            break;
+        default:
+            break;
+        }
+        nals_.push_back({nal, nal_size});
+    }
+
+    if (nals_.empty())
+    {
+        // 没有起始码的数据不是 Annex-B，原样交给下游
+        return !stripped;
+    }
+
+    bool prepend_sps = has_idr && !has_sps && !sps_.empty();
+    bool prepend_pps = has_idr && !has_pps && !pps_.empty();
+    if (!stripped && !prepend_sps && !prepend_pps)
+        return true;
+
+    // 需要改写：按 SPS、PPS、其余 NAL 的顺序重新拼出访问单元
+    size_t out_size = 0;
+    if (prepend_sps)
+        out_size += sizeof(kStartCode) + sps_.size();
+    if (prepend_pps)
+        out_size += sizeof(kStartCode) + pps_.size();
+    for (const auto &ref : nals_)
+        out_size += sizeof(kStartCode) + ref.size;
+
+    AVPacketPtr out = make_av_packet();
+    if (!out || av_new_packet(out.get(), (int)out_size) < 0)
+    {
+        std::cerr << "[Bitstream] ERROR: Could not allocate output packet." << std::endl;
+        return true; // 保留原始数据包，至少不丢帧
+    }
+    av_packet_copy_props(out.get(), packet.get());
+    out->stream_index = packet->stream_index;
+
+    uint8_t *dst = out->data;
+    auto append = [&dst](const uint8_t *data, size_t size)
+    {
+        memcpy(dst, kStartCode, sizeof(kStartCode));
+        memcpy(dst + sizeof(kStartCode), data, size);
+        dst += sizeof(kStartCode) + size;
+    };
+    if (prepend_sps)
+        append(sps_.data(), sps_.size());
+    if (prepend_pps)
+        append(pps_.data(), pps_.size());
+    for (const auto &ref : nals_)
+        append(ref.data, ref.size);
+
+    packet = std::move(out);
+    return true;
+}
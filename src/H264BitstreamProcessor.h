@@ -0,0 +1,39 @@
+#pragma once
+
+#include "FFMpegWrappers.h"
+#include <vector>
+#include <cstdint>
+
+// H.264 码流处理：位于编码器输出与 MediaSession 之间
+// 从 extradata 和码流中提取 SPS/PPS，去掉 AUD/填充 NAL，并保证每个 IDR 前都带有 SPS/PPS
+class H264BitstreamProcessor
+{
+public:
+    // 解析编码器 extradata 中的 SPS/PPS，支持 Annex-B 和 avcC 两种格式
+    void set_extradata(const uint8_t *data, int size);
+
+    // 处理一个 Annex-B 访问单元；需要改写时 packet 被替换为新的数据包，否则原样保留（不拷贝）
+    // 返回 false 表示处理后没有剩余数据，应丢弃
+    bool process(AVPacketPtr &packet);
+
+    // SPS/PPS 自上次调用以来发生变化时返回 true 并输出最新的参数集
+    bool take_parameter_sets(std::vector<uint8_t> &sps, std::vector<uint8_t> &pps);
+
+    uint64_t stripped_bytes() const { return stripped_bytes_; }
+
+private:
+    struct NalRef
+    {
+        const uint8_t *data;
+        uint32_t size;
+    };
+
+    void update_parameter_set(std::vector<uint8_t> &dst, const uint8_t *nal, uint32_t size);
+    bool parse_avcc(const uint8_t *data, int size);
+
+    std::vector<uint8_t> sps_;
+    std::vector<uint8_t> pps_;
+    bool parameters_changed_ = false;
+    std::vector<NalRef> nals_; // 当前访问单元中保留的 NAL，复用容量避免每帧分配
+    uint64_t stripped_bytes_ = 0;
+};
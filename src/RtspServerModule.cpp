@@ -1,5 +1,6 @@
 #include "RtspServerModule.h"
 #include "xop/H264Source.h" // 需要 H264Source 来创建视频源
+#include "net/MemoryManager.h"
 #include <iostream>
 
 RtspServerModule::RtspServerModule(std::shared_ptr<ThreadSafeQueue<AVPacketPtr>> encoded_packet_queue)
@@ -47,17 +48,59 @@ bool RtspServerModule::start(uint16_t port, const std::string &suffix, AVCodecCo
         return false;
     }
     // 添加 H.264 视频源到通道 0
-    session->AddSource(xop::channel_0, xop::H264Source::CreateNew());
+    h264_source_ = xop::H264Source::CreateNew();
+    session->AddSource(xop::channel_0, h264_source_);
     // 可以在这里添加 AAC 音频源到通道 1 (如果后续实现了音频)
     // session->AddSource(xop::channel_1, xop::AACSource::CreateNew(samplerate, channels, false));
 
-    // 设置连接和断开连接的回调，用于打印日志
+    if (multicast_enabled_)
+    {
+        if (!session->StartMulticast(multicast_ip_, multicast_port_, multicast_ttl_))
+        {
+            std::cerr << "[RtspServer] ERROR: Failed to start multicast." << std::endl;
+            // h264_source_ 已交给 session，随 session 一起释放；服务器已在监听，关闭后再返回
+            delete session;
+            h264_source_ = nullptr;
+            rtsp_server_->Stop();
+            rtsp_server_ = nullptr;
+            return false;
+        }
+        std::cout << "[RtspServer] Multicast group " << session->GetMulticastIp() << ":"
+                  << session->GetMulticastPort(xop::channel_0) << " (ttl " << multicast_ttl_ << ")" << std::endl;
+    }
+
+    if (pacing_multiplier_ > 0 && video_codec_ctx && video_codec_ctx->bit_rate > 0)
+    {
+        uint64_t pacing_rate = (uint64_t)(video_codec_ctx->bit_rate * pacing_multiplier_);
+        session->SetPacingRate(pacing_rate);
+        std::cout << "[RtspServer] UDP pacing at " << pacing_rate / 1000 << " kbit/s." << std::endl;
+    }
+
+    session->SetLatencyBudget(latency_budget_ms_);
+    // 慢客户端整帧丢弃后需要新的关键帧才能恢复解码（在网络线程中调用，编码器内部合并并限频）
+    session->SetKeyFrameRequestCallback([this]()
+                                        {
+        if (keyframe_request_callback_)
+            keyframe_request_callback_(); });
+
+    // 设置连接、播放和断开连接的回调：打印日志，并据此统计是否还有客户端在播放
     session->AddNotifyConnectedCallback([](xop::MediaSessionId sessionId, std::string peer_ip, uint16_t peer_port)
                                         { std::cout << "[RtspServer] Client connected: " << peer_ip << ":" << peer_port << std::endl; });
-    session->AddNotifyDisconnectedCallback([](xop::MediaSessionId sessionId, std::string peer_ip, uint16_t peer_port)
-                                           { std::cout << "[RtspServer] Client disconnected: " << peer_ip << ":" << peer_port << std::endl; });
+    session->AddNotifyPlayCallback([this](xop::MediaSessionId sessionId, std::string peer_ip, uint16_t peer_port)
+                                   { on_client_play(peer_ip, peer_port); });
+    session->AddNotifyDisconnectedCallback([this](xop::MediaSessionId sessionId, std::string peer_ip, uint16_t peer_port)
+                                           { on_client_disconnected(peer_ip, peer_port); });
 
     // 4. 将媒体会话添加到 RTSP 服务器
+    media_session_ = session;
+
+    // 编码器 extradata 中若有 SPS/PPS，在第一个客户端 DESCRIBE 之前写入 SDP
+    if (video_codec_ctx)
+    {
+        bitstream_.set_extradata(video_codec_ctx->extradata, video_codec_ctx->extradata_size);
+        publish_parameter_sets();
+    }
+
     media_session_id_ = rtsp_server_->AddSession(session);
     if (media_session_id_ == 0)
     {
@@ -87,8 +130,9 @@ bool RtspServerModule::start(uint16_t port, const std::string &suffix, AVCodecCo
 
     std::cout << "[RtspServer] Server started successfully at rtsp://<your-ip>:" << port << "/" << suffix << std::endl;
 
-    // 保存编码器的时间基，以备后用 (当前未使用，但保留)
-    video_encoder_time_base_ = video_codec_ctx->time_base;
+    // 保存编码器的时间基，以备后用 (当前未使用，但保留)；没有编码器上下文时保持默认值
+    if (video_codec_ctx)
+        video_encoder_time_base_ = video_codec_ctx->time_base;
 
     return true;
 }
@@ -125,12 +169,100 @@ void RtspServerModule::stop()
         // if (rtsp_server_) {
         //     rtsp_server_->Stop();
         // }
+        if (media_session_ && pacing_multiplier_ > 0)
+        {
+            xop::PacerStats stats = media_session_->GetPacerStats();
+            uint64_t avg_delay_us = stats.sent_packets ? stats.total_delay_us / stats.sent_packets : 0;
+            std::cout << "[RtspServer] Pacer: " << stats.sent_packets << " packets sent, " << stats.dropped_packets
+                      << " dropped, queueing delay avg " << avg_delay_us / 1000.0 << " ms, max "
+                      << stats.max_delay_us / 1000.0 << " ms." << std::endl;
+        }
+        if (media_session_ && !media_session_->IsMulticast())
+        {
+            xop::FrameRingStats stats = media_session_->GetFrameRingStats();
+            std::cout << "[RtspServer] Frame ring: " << stats.frames << " frames, " << stats.skips
+                      << " skips by lagging clients." << std::endl;
+        }
+        if (media_session_ && media_session_->IsMulticast())
+        {
+            xop::MulticastStats stats = media_session_->GetMulticastStats();
+            std::cout << "[RtspServer] Multicast: " << stats.rtp_packets << " RTP packets, " << stats.rtp_bytes
+                      << " bytes, " << stats.rtcp_packets << " RTCP packets (" << stats.receiver_reports
+                      << " receiver reports, " << stats.rtcp_reflected << " reflected), last fraction lost "
+                      << (int)stats.fraction_lost << "/256." << std::endl;
+        }
         rtsp_server_ = nullptr; // 释放对服务器对象的引用
 
+        // 打印内存池使用情况，便于调整各档容量
+        for (const auto &stats : xop::MemoryManager::Instance().GetStats())
+        {
+            std::cout << "[RtspServer] Memory pool " << stats.block_size << " B: " << stats.free_blocks << "/"
+                      << stats.num_blocks << " free, " << stats.refills << " refills, " << stats.exhausted
+                      << " exhausted." << std::endl;
+        }
+        std::cout << "[RtspServer] Memory pool fallback mallocs: " << xop::MemoryManager::Instance().GetMallocCount()
+                  << std::endl;
+
         std::cout << "[RtspServer] Server stopped completely." << std::endl;
     }
 }
 
+void RtspServerModule::set_multicast(const std::string &ip, uint16_t port, int ttl)
+{
+    multicast_enabled_ = true;
+    multicast_ip_ = ip;
+    multicast_port_ = port;
+    multicast_ttl_ = ttl;
+}
+
+void RtspServerModule::publish_parameter_sets()
+{
+    std::vector<uint8_t> sps, pps;
+    if (!bitstream_.take_parameter_sets(sps, pps))
+        return;
+
+    h264_source_->SetParameterSets(sps.data(), (uint32_t)sps.size(), pps.data(), (uint32_t)pps.size());
+    media_session_->ResetSdpMessage();
+    std::cout << "[RtspServer] H.264 parameter sets updated (SPS " << sps.size() << " bytes, PPS " << pps.size()
+              << " bytes), SDP regenerated." << std::endl;
+}
+
+void RtspServerModule::on_client_play(const std::string &peer_ip, uint16_t peer_port)
+{
+    std::cout << "[RtspServer] Client playing: " << peer_ip << ":" << peer_port << std::endl;
+
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    bool first = playing_clients_.empty();
+    playing_clients_.insert(peer_ip + ":" + std::to_string(peer_port));
+    if (first)
+    {
+        // 第一个客户端开始播放：恢复采集
+        resume_time_ = std::chrono::steady_clock::now();
+        warming_up_ = true;
+        if (demand_callback_)
+            demand_callback_(true);
+    }
+
+    // 新客户端需要从关键帧开始解码：会话已把缓存的 GOP 发给它时无需再强制 IDR
+    bool gop_cached = !first && media_session_ && media_session_->HasGopCache();
+    if (keyframe_request_callback_ && !gop_cached)
+        keyframe_request_callback_();
+}
+
+void RtspServerModule::on_client_disconnected(const std::string &peer_ip, uint16_t peer_port)
+{
+    std::cout << "[RtspServer] Client disconnected: " << peer_ip << ":" << peer_port << std::endl;
+
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    if (playing_clients_.erase(peer_ip + ":" + std::to_string(peer_port)) && playing_clients_.empty())
+    {
+        // 最后一个播放中的客户端离开：暂停采集和编码
+        warming_up_ = false;
+        if (demand_callback_)
+            demand_callback_(false);
+    }
+}
+
 // 网络事件循环线程函数
 void RtspServerModule::run_event_loop()
 {
@@ -167,33 +299,55 @@ void RtspServerModule::run_frame_dispatcher()
         if (packet->stream_index == 0 && rtsp_server_ && media_session_id_ != 0)
         {
             // 将 AVPacket 转换为 xop::AVFrame
-            // 注意：xop::AVFrame 需要不包含 H.264 起始码 (00 00 00 01)
-            // FFmpeg 编码器输出的 packet 通常是包含起始码的 Annex B 格式
-            // H264Source 内部可能会处理，或者我们需要在这里处理
+            // FFmpeg 编码器输出的 packet 是包含起始码的 Annex B 访问单元（SPS/PPS/SEI/切片）
+            // H264Source 会按起始码拆分出各个 NAL 再分别打包，这里直接整帧传入
+            // 数据必须位于引用计数缓冲中，xop::AVFrame 才能安全地延长其生命周期
+            if (av_packet_make_refcounted(packet.get()) < 0)
+            {
+                std::cerr << "[Dispatcher] Failed to make packet ref-counted." << std::endl;
+                continue;
+            }
 
-            // 简单的处理方式：假设 H264Source 能处理 Annex B
-            xop::AVFrame video_frame(packet->size);
-            if (video_frame.buffer)
-            { // 检查内存是否分配成功
-                video_frame.size = packet->size;
+            // 去掉 AUD/填充 NAL，保证 IDR 前带 SPS/PPS；参数集变化时更新 SDP
+            if (!bitstream_.process(packet))
+                continue;
+            publish_parameter_sets();
 
-                // 判断是否是关键帧 (I帧)
-                // SPS/PPS 通常和 I 帧一起发送，xop::H264Source 会处理 SDP
-                bool is_key_frame = (packet->flags & AV_PKT_FLAG_KEY);
-                video_frame.type = is_key_frame ? xop::VIDEO_FRAME_I : xop::VIDEO_FRAME_P;
+            // 零拷贝：xop::AVFrame 与 AVPacket 共享同一块数据，最后一个引用释放时才释放 packet
+            bool is_key_frame = (packet->flags & AV_PKT_FLAG_KEY);
+            uint32_t packet_size = packet->size;
+            std::shared_ptr<AVPacket> packet_holder(std::move(packet));
+            xop::AVFrame video_frame(std::shared_ptr<uint8_t>(packet_holder, packet_holder->data), packet_size);
+            // 判断是否是关键帧 (I帧)
+            // bitstream_ 已保证 I 帧前带有 SPS/PPS
+            video_frame.type = is_key_frame ? xop::VIDEO_FRAME_I : xop::VIDEO_FRAME_P;
 
-                // 设置时间戳 - 使用 H264Source 提供的函数生成基于时钟的时间戳
-                video_frame.timestamp = xop::H264Source::GetTimestamp();
+            // 设置时间戳 - 使用 H264Source 提供的函数生成基于时钟的时间戳
+            video_frame.timestamp = xop::H264Source::GetTimestamp();
 
-                // 拷贝数据
-                memcpy(video_frame.buffer.get(), packet->data, packet->size);
+            // 推送帧数据到 RTSP 服务器
+            rtsp_server_->PushFrame(media_session_id_, xop::channel_0, video_frame);
 
-                // 推送帧数据到 RTSP 服务器
-                rtsp_server_->PushFrame(media_session_id_, xop::channel_0, video_frame);
-            }
-            else
+            // 恢复采集后的第一个关键帧：记录预热耗时
+            if (is_key_frame && warming_up_.exchange(false))
             {
-                std::cerr << "[Dispatcher] Failed to allocate memory for xop::AVFrame." << std::endl;
+                std::chrono::steady_clock::time_point resume_time;
+                {
+                    std::lock_guard<std::mutex> lock(clients_mutex_);
+                    resume_time = resume_time_;
+                }
+                auto warmup_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::steady_clock::now() - resume_time)
+                                     .count();
+                if (warmup_ms > kWarmupBudgetMs)
+                {
+                    std::cerr << "[RtspServer] WARNING: First keyframe after resume took " << warmup_ms
+                              << " ms (budget " << kWarmupBudgetMs << " ms)." << std::endl;
+                }
+                else
+                {
+                    std::cout << "[RtspServer] First keyframe after resume in " << warmup_ms << " ms." << std::endl;
+                }
             }
         }
         // 如果有音频流，在这里处理 packet->stream_index == 1 的情况
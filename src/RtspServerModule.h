@@ -4,9 +4,14 @@
 #include "ThreadSafeQueue.h"
 #include "xop/RtspServer.h" // 包含 xop 库的头文件
 #include "xop/MediaSession.h"
+#include "H264BitstreamProcessor.h"
 #include <thread>
 #include <atomic>
 #include <string>
+#include <mutex>
+#include <set>
+#include <chrono>
+#include <functional>
 
 class RtspServerModule
 {
@@ -21,7 +26,34 @@ public:
     // 停止服务器
     void stop();
 
+    // 播放需求变化回调：active 为 true 表示第一个客户端开始播放，false 表示最后一个播放中的客户端已离开
+    // 在网络线程中调用，需在 start() 之前设置
+    using DemandCallback = std::function<void(bool active)>;
+    void set_demand_callback(DemandCallback callback) { demand_callback_ = std::move(callback); }
+
+    // 客户端开始播放且没有缓存的 GOP 可发时调用，用于请求关键帧，使新客户端不必等待整个 GOP
+    // 在网络线程中调用，需在 start() 之前设置
+    using KeyframeRequestCallback = std::function<void()>;
+    void set_keyframe_request_callback(KeyframeRequestCallback callback) { keyframe_request_callback_ = std::move(callback); }
+
+    // 启用组播：每帧只打包、发送一次到组播组，开销与观看人数无关
+    // ip 为空时自动分配，port 为 0 时随机选择；需在 start() 之前设置
+    void set_multicast(const std::string &ip, uint16_t port, int ttl = 16);
+
+    // UDP 客户端按编码码率的 multiplier 倍限速发送，把 I 帧的突发摊开；0 表示不限速
+    // 需在 start() 之前设置
+    void set_pacing(double multiplier) { pacing_multiplier_ = multiplier; }
+
+    // 单播客户端落后最新帧超过 ms 毫秒时整帧跳到最新的关键帧，0 表示只在帧缓冲环放不下时才跳
+    // 需在 start() 之前设置
+    void set_latency_budget(int ms) { latency_budget_ms_ = ms; }
+
 private:
+    void on_client_play(const std::string &peer_ip, uint16_t peer_port);
+    void on_client_disconnected(const std::string &peer_ip, uint16_t peer_port);
+    // SPS/PPS 有变化时写入 H264Source 并让 SDP 重新生成
+    void publish_parameter_sets();
+
     // 网络事件循环线程函数
     void run_event_loop();
     // 帧数据分发线程函数
@@ -32,10 +64,30 @@ private:
     std::unique_ptr<xop::EventLoop> event_loop_;   // xop 的事件循环
     std::shared_ptr<xop::RtspServer> rtsp_server_; // xop 的 RTSP 服务器实例
     xop::MediaSessionId media_session_id_ = 0;     // 媒体会话 ID
+    xop::MediaSession *media_session_ = nullptr;   // 由 rtsp_server_ 持有
+    xop::H264Source *h264_source_ = nullptr;       // 由 media_session_ 持有
+    H264BitstreamProcessor bitstream_;             // 只在 start() 和分发线程中使用
 
     std::unique_ptr<std::thread> event_loop_thread_; // 网络事件循环线程
     std::unique_ptr<std::thread> dispatcher_thread_; // 数据分发线程
     std::atomic_bool is_running_{false};             // 运行状态标志
 
-    AVRational video_encoder_time_base_; // 保存编码器时间基，用于日志或调试
+    AVRational video_encoder_time_base_{0, 1}; // 保存编码器时间基，用于日志或调试
+
+    DemandCallback demand_callback_;
+    KeyframeRequestCallback keyframe_request_callback_;
+
+    bool multicast_enabled_ = false;
+    std::string multicast_ip_;
+    uint16_t multicast_port_ = 0;
+    int multicast_ttl_ = 16;
+    double pacing_multiplier_ = 0;
+    int latency_budget_ms_ = 500;
+    std::mutex clients_mutex_;
+    std::set<std::string> playing_clients_; // 正在播放的客户端（ip:port）
+
+    // 从恢复采集到第一个关键帧发出的预热时间
+    std::atomic_bool warming_up_{false};
+    std::chrono::steady_clock::time_point resume_time_;
+    static const int kWarmupBudgetMs = 200;
 };
\ No newline at end of file
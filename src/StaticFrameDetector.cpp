@@ -0,0 +1,128 @@
+#include "StaticFrameDetector.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+constexpr int kLanes = 8;
+constexpr uint32_t kLanePrime = 0x9E3779B1u;
+
+// 只处理每像素 4 字节的打包格式（采集端输出的 bgr0 等）
+bool is_packed_32bpp(int format)
+{
+    return format == AV_PIX_FMT_BGR0 || format == AV_PIX_FMT_BGRA ||
+           format == AV_PIX_FMT_RGB0 || format == AV_PIX_FMT_RGBA;
+}
+}
+
+StaticFrameDetector::StaticFrameDetector(int tile_size)
+    : tile_size_(tile_size) {}
+
+void StaticFrameDetector::reset()
+{
+    width_ = 0;
+    height_ = 0;
+    format_ = AV_PIX_FMT_NONE;
+    tile_hashes_.clear();
+}
+
+uint64_t StaticFrameDetector::hash_tile(const uint8_t *data, int stride, int row_bytes, int rows)
+{
+    // 8 路互不依赖的 32 位 异或-乘法 累加，内层循环可被编译器直接向量化（pmulld）
+    uint32_t acc[kLanes] = {0x01234567u, 0x89abcdefu, 0xfedcba98u, 0x76543210u,
+                            0x0f1e2d3cu, 0x4b5a6978u, 0x8796a5b4u, 0xc3d2e1f0u};
+    const int words = row_bytes / 4;
+    const int body = words - words % kLanes;
+
+    for (int y = 0; y < rows; y++)
+    {
+        const uint8_t *row = data + (size_t)y * stride;
+        for (int i = 0; i < body; i += kLanes)
+        {
+            uint32_t w[kLanes];
+            memcpy(w, row + i * 4, sizeof(w));
+            for (int lane = 0; lane < kLanes; lane++)
+            {
+                acc[lane] = (acc[lane] ^ w[lane]) * kLanePrime;
+            }
+        }
+        for (int i = body; i < words; i++)
+        {
+            uint32_t w;
+            memcpy(&w, row + i * 4, sizeof(w));
+            acc[i % kLanes] = (acc[i % kLanes] ^ w) * kLanePrime;
+        }
+    }
+
+    // 折叠为 64 位（FNV-1a）
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int lane = 0; lane < kLanes; lane++)
+    {
+        hash = (hash ^ acc[lane]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool StaticFrameDetector::update_tile(const AVFrame *frame, int tile_x, int tile_y)
+{
+    int x = tile_x * tile_size_;
+    int y = tile_y * tile_size_;
+    int w = std::min(tile_size_, width_ - x);
+    int h = std::min(tile_size_, height_ - y);
+
+    uint64_t hash = hash_tile(frame->data[0] + (size_t)y * frame->linesize[0] + (size_t)x * 4,
+                              frame->linesize[0], w * 4, h);
+    uint64_t &stored = tile_hashes_[(size_t)tile_y * tiles_x_ + tile_x];
+    if (stored == hash)
+        return false;
+    stored = hash;
+    return true;
+}
+
+bool StaticFrameDetector::update(const AVFrame *frame)
+{
+    if (!frame || !is_packed_32bpp(frame->format))
+        return true; // 不支持的格式一律视为变化
+
+    bool geometry_changed = frame->width != width_ || frame->height != height_ || frame->format != format_;
+    if (geometry_changed)
+    {
+        width_ = frame->width;
+        height_ = frame->height;
+        format_ = frame->format;
+        tiles_x_ = (width_ + tile_size_ - 1) / tile_size_;
+        tiles_y_ = (height_ + tile_size_ - 1) / tile_size_;
+        tile_hashes_.assign((size_t)tiles_x_ * tiles_y_, 0);
+    }
+
+    bool changed = false;
+    if (!geometry_changed && get_frame_dirty_rects(frame, dirty_rects_))
+    {
+        // 只需检查与脏矩形相交的块；空列表说明画面没有变化
+        for (const auto &rect : dirty_rects_)
+        {
+            int tx0 = std::max(rect.x, 0) / tile_size_;
+            int ty0 = std::max(rect.y, 0) / tile_size_;
+            int tx1 = std::min((rect.x + rect.width - 1) / tile_size_, tiles_x_ - 1);
+            int ty1 = std::min((rect.y + rect.height - 1) / tile_size_, tiles_y_ - 1);
+            for (int ty = ty0; ty <= ty1; ty++)
+            {
+                for (int tx = tx0; tx <= tx1; tx++)
+                {
+                    changed |= update_tile(frame, tx, ty);
+                }
+            }
+        }
+        return changed;
+    }
+
+    // 必须遍历所有块以更新哈希，不能提前退出
+    for (int ty = 0; ty < tiles_y_; ty++)
+    {
+        for (int tx = 0; tx < tiles_x_; tx++)
+        {
+            changed |= update_tile(frame, tx, ty);
+        }
+    }
+    return changed || geometry_changed;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "FFMpegWrappers.h"
+#include <vector>
+#include <cstdint>
+
+// 静态帧检测：把画面划分为 64x64 的块，逐块计算哈希并与上一帧比较
+// 帧若携带脏矩形信息（XDamage 后端），只重新计算与脏矩形相交的块
+class StaticFrameDetector
+{
+public:
+    StaticFrameDetector(int tile_size = 64);
+
+    // 返回 true 表示与上一次调用时的画面不同（首帧、尺寸或格式变化也视为变化）
+    bool update(const AVFrame *frame);
+
+    // 丢弃已记录的哈希，下一帧必然被判定为变化
+    void reset();
+
+private:
+    static uint64_t hash_tile(const uint8_t *data, int stride, int row_bytes, int rows);
+    bool update_tile(const AVFrame *frame, int tile_x, int tile_y);
+
+    int tile_size_;
+    int width_ = 0;
+    int height_ = 0;
+    int format_ = AV_PIX_FMT_NONE;
+    int tiles_x_ = 0;
+    int tiles_y_ = 0;
+    std::vector<uint64_t> tile_hashes_;
+    std::vector<DirtyRect> dirty_rects_;
+};
@@ -0,0 +1,238 @@
+#include "XcbDamageGrabber.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <xcb/xcb.h>
+#include <xcb/xfixes.h>
+#include <xcb/damage.h>
+
+XcbDamageGrabber::XcbDamageGrabber() {}
+
+XcbDamageGrabber::~XcbDamageGrabber()
+{
+    close();
+}
+
+bool XcbDamageGrabber::open(const char *display_name, int width, int height, int num_buffers)
+{
+    // 只需一个共享段，用作脏矩形的中转区
+    if (!shm_.open(display_name, width, height, 1))
+    {
+        return false;
+    }
+    xcb_connection_t *conn = shm_.connection();
+
+    const xcb_query_extension_reply_t *xfixes_ext = xcb_get_extension_data(conn, &xcb_xfixes_id);
+    const xcb_query_extension_reply_t *damage_ext = xcb_get_extension_data(conn, &xcb_damage_id);
+    if (!xfixes_ext || !xfixes_ext->present || !damage_ext || !damage_ext->present)
+    {
+        std::cerr << "[XcbDamage] ERROR: X server does not support XFixes/XDamage." << std::endl;
+        close();
+        return false;
+    }
+
+    // 扩展要求先协商版本才能使用
+    free(xcb_xfixes_query_version_reply(conn, xcb_xfixes_query_version(conn, 5, 0), nullptr));
+    xcb_damage_query_version_reply_t *damage_version =
+        xcb_damage_query_version_reply(conn, xcb_damage_query_version(conn, 1, 1), nullptr);
+    if (!damage_version)
+    {
+        std::cerr << "[XcbDamage] ERROR: XDamage version negotiation failed." << std::endl;
+        close();
+        return false;
+    }
+    free(damage_version);
+
+    region_ = xcb_generate_id(conn);
+    xcb_xfixes_create_region(conn, region_, 0, nullptr);
+    damage_ = xcb_generate_id(conn);
+    xcb_damage_create(conn, damage_, shm_.root(), XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+
+    // 输出帧来自固定容量的缓冲池
+    if (!pool_.init(shm_.width(), shm_.height(), shm_.pixel_format(), num_buffers))
+    {
+        close();
+        return false;
+    }
+
+    // 先创建 Damage 再做首次整帧抓取，保证不会漏掉其间的变化
+    // 常驻帧缓冲与池中的帧使用相同的 64 字节对齐行宽
+    stride_ = (shm_.width() * 4 + 63) & ~63;
+    framebuffer_.assign((size_t)stride_ * shm_.height(), 0);
+    if (!shm_.grab_regions({{0, 0, shm_.width(), shm_.height()}}, framebuffer_.data(), stride_))
+    {
+        std::cerr << "[XcbDamage] ERROR: Initial full-frame grab failed." << std::endl;
+        close();
+        return false;
+    }
+    unreported_.rects.clear();
+    unreported_.full = true;
+    regrab_full_ = false;
+
+    std::cout << "[XcbDamage] Opened " << shm_.width() << "x" << shm_.height() << " with " << num_buffers << " frame buffers." << std::endl;
+    return true;
+}
+
+void XcbDamageGrabber::close()
+{
+    xcb_connection_t *conn = shm_.connection();
+    if (conn)
+    {
+        if (damage_)
+            xcb_damage_destroy(conn, damage_);
+        if (region_)
+            xcb_xfixes_destroy_region(conn, region_);
+    }
+    damage_ = 0;
+    region_ = 0;
+    shm_.close();
+    pending_.clear();
+    framebuffer_.clear();
+}
+
+bool XcbDamageGrabber::fetch_damage(std::vector<DirtyRect> &rects)
+{
+    xcb_connection_t *conn = shm_.connection();
+    rects.clear();
+
+    // DamageNotify 只用于唤醒，内容统一从 region 中取，这里丢弃所有排队的事件
+    xcb_generic_event_t *event = nullptr;
+    while ((event = xcb_poll_for_event(conn)) != nullptr)
+    {
+        free(event);
+    }
+
+    // 把累计的损坏区域移入 region_ 并清空 Damage 对象
+    xcb_damage_subtract(conn, damage_, XCB_NONE, region_);
+    xcb_xfixes_fetch_region_reply_t *reply = xcb_xfixes_fetch_region_reply(conn, xcb_xfixes_fetch_region(conn, region_), nullptr);
+    if (!reply)
+    {
+        return false;
+    }
+
+    const int width = shm_.width();
+    const int height = shm_.height();
+    const xcb_rectangle_t *xrects = xcb_xfixes_fetch_region_rectangles(reply);
+    const int num_rects = xcb_xfixes_fetch_region_rectangles_length(reply);
+    int64_t area = 0;
+    for (int i = 0; i < num_rects; i++)
+    {
+        // 裁剪到采集区域内
+        int x0 = std::max<int>(xrects[i].x, 0);
+        int y0 = std::max<int>(xrects[i].y, 0);
+        int x1 = std::min<int>(xrects[i].x + xrects[i].width, width);
+        int y1 = std::min<int>(xrects[i].y + xrects[i].height, height);
+        if (x1 > x0 && y1 > y0)
+        {
+            rects.push_back({x0, y0, x1 - x0, y1 - y0});
+            area += (int64_t)(x1 - x0) * (y1 - y0);
+        }
+    }
+    free(reply);
+
+    if (rects.size() > kMaxRects || area * 2 > (int64_t)width * height)
+    {
+        rects.assign(1, {0, 0, width, height});
+    }
+    return true;
+}
+
+void XcbDamageGrabber::copy_rects(const std::vector<DirtyRect> &rects, uint8_t *dst, int dst_stride)
+{
+    for (const auto &rect : rects)
+    {
+        const size_t row_bytes = (size_t)rect.width * 4;
+        for (int row = 0; row < rect.height; row++)
+        {
+            memcpy(dst + (size_t)(rect.y + row) * dst_stride + (size_t)rect.x * 4,
+                   framebuffer_.data() + (size_t)(rect.y + row) * stride_ + (size_t)rect.x * 4, row_bytes);
+        }
+    }
+}
+
+void XcbDamageGrabber::accumulate(PendingRects &pending, const std::vector<DirtyRect> &damage)
+{
+    if (pending.full)
+        return;
+    pending.rects.insert(pending.rects.end(), damage.begin(), damage.end());
+    if (pending.rects.size() > kMaxRects)
+    {
+        pending.rects.clear();
+        pending.full = true;
+    }
+}
+
+void XcbDamageGrabber::invalidate()
+{
+    regrab_full_ = true;
+    for (auto &entry : pending_)
+    {
+        entry.second.rects.clear();
+        entry.second.full = true;
+    }
+    unreported_.rects.clear();
+    unreported_.full = true;
+}
+
+AVFramePtr XcbDamageGrabber::grab()
+{
+    if (!shm_.connection())
+        return nullptr;
+
+    std::vector<DirtyRect> damage;
+    if (!fetch_damage(damage))
+    {
+        // subtract 已清空 Damage 对象，这些区域不会再上报
+        std::cerr << "[XcbDamage] ERROR: Failed to fetch damage region." << std::endl;
+        invalidate();
+        return nullptr;
+    }
+    if (regrab_full_)
+    {
+        damage.assign(1, {0, 0, shm_.width(), shm_.height()});
+    }
+
+    // 只读取变化的区域，常驻帧缓冲随之与屏幕保持一致
+    if (!damage.empty() && !shm_.grab_regions(damage, framebuffer_.data(), stride_))
+    {
+        std::cerr << "[XcbDamage] ERROR: Failed to grab damaged regions." << std::endl;
+        invalidate();
+        return nullptr;
+    }
+    regrab_full_ = false;
+
+    // 把本次脏区域记到每个输出缓冲以及待上报列表上
+    for (auto &entry : pending_)
+    {
+        accumulate(entry.second, damage);
+    }
+    accumulate(unreported_, damage);
+
+    auto frame = pool_.acquire();
+    if (!frame)
+        return nullptr; // 下游来不及消费，本帧的脏区域留待下次输出
+
+    // 补齐该缓冲落下的区域，拷贝量与变化面积成正比；第一次使用的缓冲需整帧拷贝
+    auto iter = pending_.find(frame->data[0]);
+    if (iter == pending_.end() || iter->second.full)
+    {
+        copy_rects({{0, 0, frame->width, frame->height}}, frame->data[0], frame->linesize[0]);
+    }
+    else
+    {
+        copy_rects(iter->second.rects, frame->data[0], frame->linesize[0]);
+    }
+    PendingRects &pending = pending_[frame->data[0]];
+    pending.rects.clear();
+    pending.full = false;
+
+    if (unreported_.full)
+    {
+        unreported_.rects.assign(1, {0, 0, frame->width, frame->height});
+    }
+    set_frame_dirty_rects(frame.get(), unreported_.rects);
+    unreported_.rects.clear();
+    unreported_.full = false;
+    return frame;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "FFMpegWrappers.h"
+#include "XcbShmGrabber.h"
+#include "FramePool.h"
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// 基于 XDamage 的增量屏幕抓取器
+// 订阅根窗口的 Damage 事件，每帧只从 X 服务器读取发生变化的矩形写入常驻帧缓冲，
+// 输出帧从 FramePool 中循环复用的缓冲取出，仅补齐该缓冲自上次使用以来落下的脏区域。
+// 每个输出帧通过 opaque_ref 携带相对上一输出帧的脏矩形列表（见 set_frame_dirty_rects）。
+class XcbDamageGrabber
+{
+public:
+    XcbDamageGrabber();
+    ~XcbDamageGrabber();
+
+    bool open(const char *display_name, int width, int height, int num_buffers = 4);
+    void close();
+
+    // 抓取一帧；失败或所有输出缓冲都被下游占用时返回 nullptr
+    AVFramePtr grab();
+
+    int width() const { return shm_.width(); }
+    int height() const { return shm_.height(); }
+
+private:
+    // 某块输出缓冲自上次输出以来累计、尚未补齐的脏矩形（只在采集线程访问）
+    struct PendingRects
+    {
+        std::vector<DirtyRect> rects;
+        bool full = false;
+    };
+
+    bool fetch_damage(std::vector<DirtyRect> &rects);
+    void copy_rects(const std::vector<DirtyRect> &rects, uint8_t *dst, int dst_stride);
+    static void accumulate(PendingRects &pending, const std::vector<DirtyRect> &damage);
+    // 已从 Damage 对象减去的区域没能读到时调用：下次整帧重抓，各输出缓冲和待上报列表都按整帧处理
+    void invalidate();
+
+    XcbShmGrabber shm_;
+    uint32_t damage_ = 0;
+    uint32_t region_ = 0;
+    int stride_ = 0;
+
+    std::vector<uint8_t> framebuffer_; // 常驻帧缓冲，始终与屏幕内容同步
+    PendingRects unreported_;           // 因无空闲缓冲而未随帧输出的脏矩形
+    bool regrab_full_ = false;          // 常驻帧缓冲可能过期，下次需整帧重抓
+    FramePool pool_;                    // 输出帧缓冲池
+    std::unordered_map<const uint8_t *, PendingRects> pending_; // 以缓冲地址区分池中的各块缓冲
+
+    // 矩形过多或脏区域过大时，直接按整帧处理更划算
+    static const size_t kMaxRects = 64;
+};
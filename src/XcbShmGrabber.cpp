@@ -0,0 +1,260 @@
+#include "XcbShmGrabber.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+XcbShmGrabber::ShmSegment::~ShmSegment()
+{
+    if (data)
+    {
+        shmdt(data);
+    }
+}
+
+XcbShmGrabber::XcbShmGrabber() {}
+
+XcbShmGrabber::~XcbShmGrabber()
+{
+    close();
+}
+
+bool XcbShmGrabber::open(const char *display_name, int width, int height, int num_segments)
+{
+    int screen_num = 0;
+    conn_ = xcb_connect(display_name, &screen_num);
+    if (!conn_ || xcb_connection_has_error(conn_))
+    {
+        std::cerr << "[XcbShm] ERROR: Cannot connect to X server '" << (display_name ? display_name : "") << "'." << std::endl;
+        close();
+        return false;
+    }
+
+    const xcb_setup_t *setup = xcb_get_setup(conn_);
+    xcb_screen_iterator_t screen_iter = xcb_setup_roots_iterator(setup);
+    for (int i = 0; i < screen_num && screen_iter.rem; i++)
+    {
+        xcb_screen_next(&screen_iter);
+    }
+    xcb_screen_t *screen = screen_iter.data;
+    if (!screen)
+    {
+        std::cerr << "[XcbShm] ERROR: Cannot find screen #" << screen_num << "." << std::endl;
+        close();
+        return false;
+    }
+
+    const xcb_query_extension_reply_t *shm_ext = xcb_get_extension_data(conn_, &xcb_shm_id);
+    if (!shm_ext || !shm_ext->present)
+    {
+        std::cerr << "[XcbShm] ERROR: X server does not support MIT-SHM." << std::endl;
+        close();
+        return false;
+    }
+
+    // 只支持 32bpp 小端的 Z-Pixmap，即内存布局为 B,G,R,X（与 x11grab 输出的 bgr0 一致）
+    int bits_per_pixel = 0;
+    xcb_format_iterator_t fmt_iter = xcb_setup_pixmap_formats_iterator(setup);
+    for (; fmt_iter.rem; xcb_format_next(&fmt_iter))
+    {
+        if (fmt_iter.data->depth == screen->root_depth)
+        {
+            bits_per_pixel = fmt_iter.data->bits_per_pixel;
+            break;
+        }
+    }
+    if (bits_per_pixel != 32 || setup->image_byte_order != XCB_IMAGE_ORDER_LSB_FIRST)
+    {
+        std::cerr << "[XcbShm] ERROR: Unsupported pixmap format (depth " << (int)screen->root_depth
+                  << ", " << bits_per_pixel << " bpp)." << std::endl;
+        close();
+        return false;
+    }
+
+    root_ = screen->root;
+    width_ = std::min<int>(width, screen->width_in_pixels);
+    height_ = std::min<int>(height, screen->height_in_pixels);
+    stride_ = width_ * 4;
+    pix_fmt_ = AV_PIX_FMT_BGR0;
+
+    const size_t segment_size = (size_t)stride_ * height_;
+    for (int i = 0; i < num_segments; i++)
+    {
+        auto segment = std::make_shared<ShmSegment>();
+        segment->size = segment_size;
+        segment->shmid = shmget(IPC_PRIVATE, segment_size, IPC_CREAT | 0600);
+        if (segment->shmid < 0)
+        {
+            std::cerr << "[XcbShm] ERROR: shmget failed for " << segment_size << " bytes." << std::endl;
+            close();
+            return false;
+        }
+
+        void *addr = shmat(segment->shmid, nullptr, 0);
+        if (addr == (void *)-1)
+        {
+            shmctl(segment->shmid, IPC_RMID, nullptr);
+            std::cerr << "[XcbShm] ERROR: shmat failed." << std::endl;
+            close();
+            return false;
+        }
+        segment->data = (uint8_t *)addr;
+
+        segment->shmseg = xcb_generate_id(conn_);
+        xcb_generic_error_t *err = xcb_request_check(conn_, xcb_shm_attach_checked(conn_, segment->shmseg, segment->shmid, 0));
+        // 双方都已 attach（或失败），立即标记删除，进程退出时由内核回收
+        shmctl(segment->shmid, IPC_RMID, nullptr);
+        if (err)
+        {
+            free(err);
+            std::cerr << "[XcbShm] ERROR: X server failed to attach shared memory segment." << std::endl;
+            close();
+            return false;
+        }
+        segments_.push_back(std::move(segment));
+    }
+
+    std::cout << "[XcbShm] Opened " << width_ << "x" << height_ << " with " << num_segments << " shared segments." << std::endl;
+    return true;
+}
+
+void XcbShmGrabber::close()
+{
+    if (conn_)
+    {
+        for (auto &segment : segments_)
+        {
+            if (segment->shmseg)
+            {
+                xcb_shm_detach(conn_, segment->shmseg);
+            }
+        }
+        xcb_flush(conn_);
+        xcb_disconnect(conn_);
+        conn_ = nullptr;
+    }
+    // 仍被下游帧引用的段会在最后一个 AVBufferRef 释放时 shmdt
+    segments_.clear();
+}
+
+void XcbShmGrabber::release_segment(void *opaque, uint8_t *data)
+{
+    auto holder = static_cast<std::shared_ptr<ShmSegment> *>(opaque);
+    (*holder)->in_use = false;
+    delete holder;
+}
+
+std::shared_ptr<XcbShmGrabber::ShmSegment> XcbShmGrabber::acquire_segment()
+{
+    // 轮询查找一个空闲的共享段
+    for (size_t i = 0; i < segments_.size(); i++)
+    {
+        size_t index = (next_segment_ + i) % segments_.size();
+        if (!segments_[index]->in_use)
+        {
+            next_segment_ = index + 1;
+            return segments_[index];
+        }
+    }
+    return nullptr;
+}
+
+AVFramePtr XcbShmGrabber::grab()
+{
+    if (!conn_)
+        return nullptr;
+
+    std::shared_ptr<ShmSegment> segment = acquire_segment();
+    if (!segment)
+        return nullptr;
+
+    xcb_generic_error_t *err = nullptr;
+    xcb_shm_get_image_cookie_t cookie = xcb_shm_get_image(conn_, root_, 0, 0, width_, height_, ~0u,
+                                                          XCB_IMAGE_FORMAT_Z_PIXMAP, segment->shmseg, 0);
+    xcb_shm_get_image_reply_t *reply = xcb_shm_get_image_reply(conn_, cookie, &err);
+    if (!reply)
+    {
+        if (err)
+        {
+            std::cerr << "[XcbShm] ERROR: GetImage failed, error code " << (int)err->error_code << "." << std::endl;
+            free(err);
+        }
+        return nullptr;
+    }
+    free(reply);
+
+    auto frame = make_av_frame();
+    if (!frame)
+        return nullptr;
+
+    segment->in_use = true;
+    auto holder = new std::shared_ptr<ShmSegment>(segment);
+    frame->buf[0] = av_buffer_create(segment->data, segment->size, &XcbShmGrabber::release_segment,
+                                     holder, AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0])
+    {
+        delete holder;
+        segment->in_use = false;
+        return nullptr;
+    }
+    frame->data[0] = segment->data;
+    frame->linesize[0] = stride_;
+    frame->width = width_;
+    frame->height = height_;
+    frame->format = pix_fmt_;
+    return frame;
+}
+
+bool XcbShmGrabber::grab_regions(const std::vector<DirtyRect> &rects, uint8_t *dst, int dst_stride)
+{
+    if (!conn_ || rects.empty())
+        return conn_ != nullptr;
+
+    std::shared_ptr<ShmSegment> segment = acquire_segment();
+    if (!segment)
+        return false;
+
+    // 先连续发出所有请求，各矩形依次紧凑地写入共享段的不同偏移，只付出一次往返延迟
+    std::vector<xcb_shm_get_image_cookie_t> cookies;
+    std::vector<uint32_t> offsets;
+    cookies.reserve(rects.size());
+    offsets.reserve(rects.size());
+    uint32_t offset = 0;
+    for (const auto &rect : rects)
+    {
+        uint32_t rect_size = (uint32_t)rect.width * rect.height * 4;
+        if (offset + rect_size > segment->size)
+            break;
+        cookies.push_back(xcb_shm_get_image(conn_, root_, rect.x, rect.y, rect.width, rect.height, ~0u,
+                                            XCB_IMAGE_FORMAT_Z_PIXMAP, segment->shmseg, offset));
+        offsets.push_back(offset);
+        offset += rect_size;
+    }
+
+    bool ok = cookies.size() == rects.size();
+    for (size_t i = 0; i < cookies.size(); i++)
+    {
+        xcb_generic_error_t *err = nullptr;
+        xcb_shm_get_image_reply_t *reply = xcb_shm_get_image_reply(conn_, cookies[i], &err);
+        if (!reply)
+        {
+            free(err);
+            ok = false;
+            continue;
+        }
+        free(reply);
+
+        const DirtyRect &rect = rects[i];
+        const uint8_t *src = segment->data + offsets[i];
+        const size_t row_bytes = (size_t)rect.width * 4;
+        for (int row = 0; row < rect.height; row++)
+        {
+            memcpy(dst + (size_t)(rect.y + row) * dst_stride + (size_t)rect.x * 4, src + row * row_bytes, row_bytes);
+        }
+    }
+    return ok;
+}
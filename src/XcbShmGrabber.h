@@ -0,0 +1,65 @@
+#pragma once
+
+#include "FFMpegWrappers.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+// 前向声明，避免在头文件中引入 xcb
+struct xcb_connection_t;
+
+// 基于 XCB + MIT-SHM 的原生屏幕抓取器
+// 服务器直接把根窗口像素写入共享内存段，输出的 AVFrame 直接指向该共享内存，
+// 绕过 x11grab 的 packet 拷贝和 rawvideo 解码器。
+// 共享内存段循环复用：只要编码端还持有某个段对应的帧，该段就不会被再次写入。
+class XcbShmGrabber
+{
+public:
+    XcbShmGrabber();
+    ~XcbShmGrabber();
+
+    // num_segments 为共享内存段数量，需覆盖 采集→编码 流水线中同时在途的帧数
+    bool open(const char *display_name, int width, int height, int num_segments = 4);
+    void close();
+
+    // 抓取一帧；失败或所有共享段都被占用（下游来不及消费）时返回 nullptr
+    AVFramePtr grab();
+
+    // 只抓取给定的矩形区域并写入 dst（dst 按整帧布局，步长 dst_stride）
+    // 各矩形不能重叠，总面积不超过一帧
+    bool grab_regions(const std::vector<DirtyRect> &rects, uint8_t *dst, int dst_stride);
+
+    xcb_connection_t *connection() const { return conn_; }
+    uint32_t root() const { return root_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    AVPixelFormat pixel_format() const { return pix_fmt_; }
+
+private:
+    // 单个共享内存段，由 grabber 和引用它的 AVBufferRef 共同持有
+    struct ShmSegment
+    {
+        ~ShmSegment();
+
+        uint32_t shmseg = 0;
+        int shmid = -1;
+        uint8_t *data = nullptr;
+        size_t size = 0;
+        std::atomic_bool in_use{false};
+    };
+
+    std::shared_ptr<ShmSegment> acquire_segment();
+
+    // AVBufferRef 释放时的回调：归还共享段
+    static void release_segment(void *opaque, uint8_t *data);
+
+    xcb_connection_t *conn_ = nullptr;
+    uint32_t root_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    int stride_ = 0;
+    AVPixelFormat pix_fmt_ = AV_PIX_FMT_NONE;
+    size_t next_segment_ = 0;
+    std::vector<std::shared_ptr<ShmSegment>> segments_;
+};
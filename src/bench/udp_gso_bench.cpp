@@ -0,0 +1,179 @@
+// RtpUdpSocket::SendPackets 的基准：把 I 帧大小的突发发往本机回环接收端，对比开/关 UDP GSO 的 pps 和发送线程 CPU 时间
+// 用法：udp_gso_bench [帧数，默认 2000] [帧大小字节，默认 200000]
+// 注意：回环上接收端的内核处理也在发送线程的上下文里完成，CPU 时间包含了收包的那一半
+#include "xop/RtpUdpSocket.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using xop::RtpUdpSocket;
+
+namespace
+{
+constexpr size_t kRtpHeaderSize = 12;
+constexpr size_t kMaxPayload = 1400;
+constexpr int kRounds = 3;
+
+std::atomic<uint64_t> received{0};
+std::atomic<bool> stopping{false};
+
+double thread_cpu_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void set_buffer(int fd, int force_opt, int opt, int size)
+{
+    // 以 root 运行时用 *BUFFORCE 越过 rmem_max/wmem_max 的限制
+    if (setsockopt(fd, SOL_SOCKET, force_opt, &size, sizeof(size)) != 0)
+        setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size));
+}
+
+void receive_loop(int fd)
+{
+    constexpr int kBatch = 64;
+    static char buffers[kBatch][2048];
+    struct mmsghdr msgs[kBatch];
+    struct iovec iov[kBatch];
+    while (!stopping)
+    {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < kBatch; i++)
+        {
+            iov[i] = {buffers[i], sizeof(buffers[i])};
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        // MSG_WAITFORONE：收到一个包后不再等凑满一批
+        int n = recvmmsg(fd, msgs, kBatch, MSG_WAITFORONE, nullptr);
+        if (n > 0)
+            received += n;
+    }
+}
+
+struct Result
+{
+    double pps = 0;
+    double cpu_ns_per_packet = 0;
+    uint64_t sent = 0;
+    uint64_t lost = 0;
+    bool gso_used = false;
+};
+
+// 发 frames 个突发，每个突发后等接收端收完（最多 100ms）再发下一个，只统计 SendPackets 本身的耗时
+Result run(int fd, struct sockaddr_in *addr, int frames, size_t frame_size, bool use_gso)
+{
+    std::vector<uint8_t> frame(frame_size, 0xAB);
+    std::vector<uint8_t> headers((frame_size / kMaxPayload + 1) * kRtpHeaderSize, 0x80);
+    std::vector<std::array<struct iovec, 2>> packets;
+    for (size_t offset = 0; offset < frame_size; offset += kMaxPayload)
+    {
+        size_t len = std::min(kMaxPayload, frame_size - offset);
+        packets.push_back({{{&headers[packets.size() * kRtpHeaderSize], kRtpHeaderSize}, {&frame[offset], len}}});
+    }
+
+    Result result;
+    result.gso_used = use_gso;
+    double wall = 0, cpu = 0;
+    uint64_t base = received;
+    for (int f = 0; f < frames; f++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        double cpu_start = thread_cpu_seconds();
+        for (size_t i = 0; i < packets.size(); i += RtpUdpSocket::kMaxBatch)
+        {
+            int count = (int)std::min<size_t>(RtpUdpSocket::kMaxBatch, packets.size() - i);
+            auto iov = reinterpret_cast<struct iovec(*)[2]>(packets[i].data());
+            if (!RtpUdpSocket::SendPackets(fd, addr, iov, count, &result.gso_used))
+            {
+                std::cerr << "[Bench] ERROR: SendPackets failed: " << strerror(errno) << std::endl;
+                exit(1);
+            }
+        }
+        cpu += thread_cpu_seconds() - cpu_start;
+        wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.sent += packets.size();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        while (received - base < result.sent && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+    }
+    result.lost = result.sent - std::min<uint64_t>(received - base, result.sent);
+    result.pps = result.sent / wall;
+    result.cpu_ns_per_packet = cpu * 1e9 / result.sent;
+    return result;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t frame_size = argc > 2 ? (size_t)atoi(argv[2]) : 200000;
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (rx < 0 || tx < 0 || bind(rx, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(rx, (struct sockaddr *)&addr, &addr_len) != 0)
+    {
+        std::cerr << "[Bench] ERROR: Failed to open loopback sockets: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    set_buffer(rx, SO_RCVBUFFORCE, SO_RCVBUF, 16 << 20);
+    set_buffer(tx, SO_SNDBUFFORCE, SO_SNDBUF, 16 << 20);
+    // 接收线程退出时靠超时醒来检查 stopping
+    struct timeval timeout = {0, 100000};
+    setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::thread receiver(receive_loop, rx);
+
+    size_t packets_per_frame = (frame_size + kMaxPayload - 1) / kMaxPayload;
+    std::cout << "[Bench] " << frames << " frames x " << frame_size << " bytes (" << packets_per_frame
+              << " RTP packets) to 127.0.0.1:" << ntohs(addr.sin_port) << ", best of " << kRounds << " rounds."
+              << std::endl;
+    if (!RtpUdpSocket::IsGsoSupported())
+        std::cout << "[Bench] UDP GSO is not supported by this kernel, both runs use plain sendmmsg." << std::endl;
+
+    Result best[2];
+    for (int round = 0; round < kRounds; round++)
+    {
+        for (int gso = 0; gso < 2; gso++)
+        {
+            Result r = run(tx, &addr, frames, frame_size, gso == 1);
+            if (r.pps > best[gso].pps)
+                best[gso] = r;
+        }
+    }
+
+    const char *names[2] = {"sendmmsg", "sendmmsg + GSO"};
+    for (int gso = 0; gso < 2; gso++)
+    {
+        std::cout << "[Bench] " << names[gso] << ": " << (uint64_t)best[gso].pps << " pps, "
+                  << best[gso].cpu_ns_per_packet << " ns CPU/packet, lost " << best[gso].lost << "/"
+                  << best[gso].sent;
+        if (gso == 1 && !best[gso].gso_used)
+            std::cout << " (GSO fell back to plain sendmmsg)";
+        std::cout << std::endl;
+    }
+
+    stopping = true;
+    receiver.join();
+    close(tx);
+    close(rx);
+    return 0;
+}
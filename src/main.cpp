@@ -1,10 +1,14 @@
 #include "Capture.h"
+#include "Converter.h"
 #include "Encoder.h"
 #include "RtspServerModule.h" // 替换 Streamer.h
 #include <iostream>
 #include <csignal>
 #include <atomic>
 #include <thread> // 需要包含 <thread>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 std::atomic_bool g_stop_flag = false;
 
@@ -23,26 +27,54 @@ int main(int argc, char *argv[])
     const std::string rtsp_suffix = "live";
     const int capture_width = 1920;
     const int capture_height = 1080;
+    const int keepalive_interval_ms = 1000; // 画面静止时的保活编码间隔
+    // 像素格式转换线程数：1080p 下 4 个线程已足以让转换远快于编码
+    const int convert_threads = std::max(1, std::min(4, (int)std::thread::hardware_concurrency() / 2));
 
     // 1. 创建共享队列
     auto raw_frame_queue = std::make_shared<ThreadSafeQueue<AVFramePtr>>();
+    auto converted_frame_queue = std::make_shared<ThreadSafeQueue<AVFramePtr>>();
     auto encoded_packet_queue = std::make_shared<ThreadSafeQueue<AVPacketPtr>>();
 
+    // 采集后端通过环境变量切换，便于 A/B 对比：CAPTURE_BACKEND=x11grab|xcb-shm|xcb-damage
+    CaptureBackend capture_backend = CaptureBackend::X11Grab;
+    const char *backend_name = getenv("CAPTURE_BACKEND");
+    if (backend_name && strcmp(backend_name, "xcb-shm") == 0)
+    {
+        capture_backend = CaptureBackend::XcbShm;
+    }
+    else if (backend_name && strcmp(backend_name, "xcb-damage") == 0)
+    {
+        capture_backend = CaptureBackend::XcbDamage;
+    }
+
     // 2. 创建并初始化模块
-    Capture capture_module(raw_frame_queue);
+    Capture capture_module(raw_frame_queue, capture_backend);
     if (!capture_module.start())
     {
         std::cerr << "Failed to start Capture module." << std::endl;
         return -1;
     }
 
-    Encoder encoder_module(raw_frame_queue, encoded_packet_queue);
+    Encoder encoder_module(converted_frame_queue, encoded_packet_queue);
     if (!encoder_module.start(capture_width, capture_height))
     {
         std::cerr << "Failed to start Encoder module." << std::endl;
         return -1;
     }
 
+    // 转换阶段输出编码器所需的像素格式
+    Converter converter_module(raw_frame_queue, converted_frame_queue);
+    converter_module.set_keepalive_interval(keepalive_interval_ms);
+    // 调试用：CONVERTER_SELF_TEST=1 时启动前自检 SIMD 颜色转换（与标量实现、swscale 对比）
+    const char *self_test = getenv("CONVERTER_SELF_TEST");
+    converter_module.set_self_test(self_test && strcmp(self_test, "0") != 0);
+    if (!converter_module.start(capture_width, capture_height, encoder_module.get_codec_context()->pix_fmt, convert_threads))
+    {
+        std::cerr << "Failed to start Converter module." << std::endl;
+        return -1;
+    }
+
     // 获取编码器上下文，确保编码器已初始化
     AVCodecContext *encoder_ctx = encoder_module.get_codec_context();
     if (!encoder_ctx)
@@ -56,6 +88,43 @@ int main(int argc, char *argv[])
     }
 
     RtspServerModule rtsp_server_module(encoded_packet_queue);
+    // 按需运行：没有客户端播放时暂停采集（转换和编码随之空闲），第一个客户端 PLAY 时立即恢复
+    // 采集先处于暂停状态，必须在 RTSP 服务启动之前设置，避免与第一个 PLAY 竞争
+    capture_module.pause();
+    rtsp_server_module.set_demand_callback([&](bool active)
+                                           {
+        if (active)
+            capture_module.resume();
+        else
+            capture_module.pause(); });
+    // 每个客户端 PLAY 时请求关键帧（编码器内部合并并限频），转换阶段在请求满足前不跳过静态帧
+    rtsp_server_module.set_keyframe_request_callback([&]()
+                                                     { encoder_module.request_keyframe(); });
+    converter_module.set_force_output([&]()
+                                      { return encoder_module.keyframe_pending(); });
+    // 组播通过环境变量开启：RTSP_MULTICAST=1 自动分配组播地址，或 RTSP_MULTICAST=239.0.0.1:5004 指定地址和端口
+    const char *multicast = getenv("RTSP_MULTICAST");
+    if (multicast && strcmp(multicast, "0") != 0)
+    {
+        std::string group = multicast;
+        std::string ip;
+        uint16_t port = 0;
+        if (group != "1")
+        {
+            size_t colon = group.find(':');
+            ip = group.substr(0, colon);
+            if (colon != std::string::npos)
+                port = (uint16_t)atoi(group.c_str() + colon + 1);
+        }
+        rtsp_server_module.set_multicast(ip, port);
+    }
+    // UDP 客户端限速发送，默认为编码码率的 4 倍，RTSP_PACING=0 关闭
+    const char *pacing = getenv("RTSP_PACING");
+    rtsp_server_module.set_pacing(pacing ? atof(pacing) : 4.0);
+    // 慢客户端允许落后的时间，超过后跳到最新的关键帧
+    const char *latency = getenv("RTSP_LATENCY_MS");
+    if (latency)
+        rtsp_server_module.set_latency_budget(atoi(latency));
     // 启动 RTSP 服务器模块，传入必要的参数
     if (!rtsp_server_module.start(rtsp_port, rtsp_suffix, encoder_ctx))
     {
@@ -65,6 +134,7 @@ int main(int argc, char *argv[])
 
     // 3. 启动工作线程
     std::thread capture_thread(&Capture::run, &capture_module);
+    std::thread converter_thread(&Converter::run, &converter_module);
     std::thread encoder_thread(&Encoder::run, &encoder_module);
     // RtspServerModule 内部已经启动了它自己的线程 (网络线程和分发线程)
 
@@ -80,12 +150,15 @@ int main(int argc, char *argv[])
     std::cout << "Stopping all modules..." << std::endl;
     // 按照依赖反向顺序停止：先停止接收数据的，再停止发送数据的
     rtsp_server_module.stop(); // 停止服务器会停止其内部线程
-    encoder_module.stop();     // 停止编码器会停止从 raw_queue 取数据
+    encoder_module.stop();     // 停止编码器会停止从 converted_queue 取数据
+    converter_module.stop();   // 停止转换器会停止从 raw_queue 取数据
     capture_module.stop();     // 停止采集器会停止向 raw_queue 放数据
 
     // 6. 等待工作线程结束
     if (capture_thread.joinable())
         capture_thread.join();
+    if (converter_thread.joinable())
+        converter_thread.join();
     if (encoder_thread.joinable())
         encoder_thread.join();
     // RtspServerModule 的线程在其 stop() 方法内部已经被 join
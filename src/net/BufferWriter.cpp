@@ -4,9 +4,32 @@
 #include "BufferWriter.h"
 #include "Socket.h"
 #include "SocketUtil.h"
+#include "MemoryManager.h"
+#include <climits>
 
 using namespace xop;
 
+// Linux 上 IOV_MAX 为 1024; 缓冲数组在栈上, 不超过这个数
+#if defined(IOV_MAX) && IOV_MAX < 1024
+static const int kMaxIovecs = IOV_MAX;
+#else
+static const int kMaxIovecs = 1024;
+#endif
+
+#if defined(__linux) || defined(__linux__)
+static inline void SetBuffer(struct iovec& buf, char* data, uint32_t size)
+{
+	buf.iov_base = data;
+	buf.iov_len = size;
+}
+#elif defined(WIN32) || defined(_WIN32)
+static inline void SetBuffer(WSABUF& buf, char* data, uint32_t size)
+{
+	buf.buf = data;
+	buf.len = size;
+}
+#endif
+
 void xop::WriteUint32BE(char* p, uint32_t value)
 {
 	p[0] = value >> 24;
@@ -65,8 +88,11 @@ bool BufferWriter::Append(std::shared_ptr<char> data, uint32_t size, uint32_t in
 		return false;
 	}
      
-	Packet pkt = { data, size, index };
-	buffer_.emplace(std::move(pkt));
+	Packet pkt;
+	pkt.data = data;
+	pkt.size = size;
+	pkt.writeIndex = index;
+	buffer_.emplace_back(std::move(pkt));
 	return true;
 }
 
@@ -81,14 +107,108 @@ bool BufferWriter::Append(const char* data, uint32_t size, uint32_t index)
 	}
      
 	Packet pkt;
-	pkt.data.reset(new char[size+512], std::default_delete<char[]>());
+	pkt.data = AllocBuffer(size);
 	memcpy(pkt.data.get(), data, size);
 	pkt.size = size;
 	pkt.writeIndex = index;
-	buffer_.emplace(std::move(pkt));
+	buffer_.emplace_back(std::move(pkt));
 	return true;
 }
 
+bool BufferWriter::Append(const char* header, uint32_t header_size, std::shared_ptr<char> data, uint32_t size, uint32_t index)
+{
+	if (size <= index || header_size > sizeof(Packet::header)) {
+		return false;
+	}
+
+	if (reserved_ > 0) {
+		reserved_--;
+	}
+	else if ((int)buffer_.size() >= max_queue_length_) {
+		return false;
+	}
+
+	Packet pkt;
+	pkt.data = data;
+	pkt.size = size;
+	pkt.writeIndex = index;
+	memcpy(pkt.header, header, header_size);
+	pkt.headerSize = header_size;
+	buffer_.emplace_back(std::move(pkt));
+	return true;
+}
+
+int BufferWriter::SendBatch(SOCKET sockfd, uint32_t* batch_size)
+{
+	// 每个包最多占两个缓冲: 头部和数据各自未发送的部分
+#if defined(__linux) || defined(__linux__)
+	struct iovec bufs[kMaxIovecs];
+#elif defined(WIN32) || defined(_WIN32)
+	WSABUF bufs[kMaxIovecs];
+#endif
+	int count = 0;
+	uint32_t total = 0;
+
+	for (auto& pkt : buffer_) {
+		if (count + 2 > kMaxIovecs) {
+			break;
+		}
+
+		if (pkt.headerIndex < pkt.headerSize) {
+			SetBuffer(bufs[count++], pkt.header + pkt.headerIndex, pkt.headerSize - pkt.headerIndex);
+			total += pkt.headerSize - pkt.headerIndex;
+		}
+		SetBuffer(bufs[count++], pkt.data.get() + pkt.writeIndex, pkt.size - pkt.writeIndex);
+		total += pkt.size - pkt.writeIndex;
+	}
+
+	*batch_size = total;
+
+#if defined(__linux) || defined(__linux__)
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = bufs;
+	msg.msg_iovlen = count;
+
+	int flags = 0;
+#if defined(MSG_MORE)
+	if (more_) {
+		flags |= MSG_MORE;
+	}
+#endif
+	return (int)::sendmsg(sockfd, &msg, flags);
+#elif defined(WIN32) || defined(_WIN32)
+	DWORD bytes_sent = 0;
+	if (WSASend(sockfd, bufs, count, &bytes_sent, 0, NULL, NULL) != 0) {
+		return -1;
+	}
+	return (int)bytes_sent;
+#endif
+}
+
+void BufferWriter::Consume(uint32_t bytes)
+{
+	while (bytes > 0 && !buffer_.empty()) {
+		Packet& pkt = buffer_.front();
+
+		uint32_t header_left = pkt.headerSize - pkt.headerIndex;
+		if (bytes < header_left) {
+			pkt.headerIndex += bytes;
+			return;
+		}
+		pkt.headerIndex = pkt.headerSize;
+		bytes -= header_left;
+
+		uint32_t data_left = pkt.size - pkt.writeIndex;
+		if (bytes < data_left) {
+			pkt.writeIndex += bytes;
+			return;
+		}
+		bytes -= data_left;
+		buffer_.pop_front();
+	}
+}
+
 int BufferWriter::Send(SOCKET sockfd, int timeout)
 {		
 	if (timeout > 0) {
@@ -96,36 +216,31 @@ int BufferWriter::Send(SOCKET sockfd, int timeout)
 	}
       
 	int ret = 0;
-	int count = 1;
 
-	do
-	{
-		if (buffer_.empty()) {
-			return 0;
-		}
-		
-		count -= 1;
-		Packet &pkt = buffer_.front();
-		ret = ::send(sockfd, pkt.data.get() + pkt.writeIndex, pkt.size - pkt.writeIndex, 0);
+	while (!buffer_.empty()) {
+		uint32_t batch_size = 0;
+		ret = SendBatch(sockfd, &batch_size);
 		if (ret > 0) {
-			pkt.writeIndex += ret;
-			if (pkt.size == pkt.writeIndex) {
-				count += 1;
-				buffer_.pop();
+			Consume((uint32_t)ret);
+			if ((uint32_t)ret < batch_size) {
+				break; // socket 发送缓冲区已满
 			}
 		}
-		else if (ret < 0) {
+		else {
+			if (ret < 0) {
 #if defined(__linux) || defined(__linux__)
-		if (errno == EINTR || errno == EAGAIN) 
+				if (errno == EINTR || errno == EAGAIN) 
 #elif defined(WIN32) || defined(_WIN32)
-			int error = WSAGetLastError();
-			if (error == WSAEWOULDBLOCK || error == WSAEINPROGRESS || error == 0)
+				int error = WSAGetLastError();
+				if (error == WSAEWOULDBLOCK || error == WSAEINPROGRESS || error == 0)
 #endif
-			{
-				ret = 0;
+				{
+					ret = 0;
+				}
 			}
+			break;
 		}
-	} while (count > 0);
+	}
 
 	if (timeout > 0) {
 		SocketUtil::SetNonBlock(sockfd);
@@ -134,4 +249,3 @@ int BufferWriter::Send(SOCKET sockfd, int timeout)
 	return ret;
 }
 
-
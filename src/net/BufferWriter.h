@@ -6,7 +6,7 @@
 
 #include <cstdint>
 #include <memory>
-#include <queue>
+#include <deque>
 #include <string>
 #include "Socket.h"
 
@@ -28,14 +28,29 @@ public:
 
 	bool Append(std::shared_ptr<char> data, uint32_t size, uint32_t index=0);
 	bool Append(const char* data, uint32_t size, uint32_t index=0);
+	// 头部拷贝一份, data[index, size) 共享不拷贝; 两者用一次聚合写发出
+	bool Append(const char* header, uint32_t header_size, std::shared_ptr<char> data, uint32_t size, uint32_t index=0);
+	// 每次把尽量多的排队包合并成一次 writev/WSASend, 直到 socket 写满或队列为空
 	int Send(SOCKET sockfd, int timeout=0);
 
+	// 帧边界模式: 设置时写操作带 MSG_MORE, 内核暂不发出不满的分段, 等这一帧其余的包排进来
+	void SetMore(bool more)
+	{ more_ = more; }
+
 	bool IsEmpty() const 
 	{ return buffer_.empty(); }
 
 	bool IsFull() const 
 	{ return ((int)buffer_.size() >= max_queue_length_ ? true : false); }
 
+	// 还能放下 count 个包, 整帧排队时不会有包被拒绝
+	bool CanAppend(uint32_t count) const
+	{ return (int)(buffer_.size() + count) <= max_queue_length_; }
+
+	// 为接下来的 count 个带头部的包预留位置, 它们不受队列长度限制, 已接纳的一帧不会被截断
+	void Reserve(uint32_t count)
+	{ reserved_ = count; }
+
 	uint32_t Size() const 
 	{ return (uint32_t)buffer_.size(); }
 	
@@ -45,10 +60,18 @@ private:
 		std::shared_ptr<char> data;
 		uint32_t size;
 		uint32_t writeIndex;
+		char header[16];
+		uint32_t headerSize = 0;
+		uint32_t headerIndex = 0;
 	} Packet;
 
-	std::queue<Packet> buffer_;  		
+	int SendBatch(SOCKET sockfd, uint32_t* batch_size);
+	void Consume(uint32_t bytes);
+
+	std::deque<Packet> buffer_;  		
 	int max_queue_length_ = 0;
+	uint32_t reserved_ = 0;
+	bool more_ = false;
 	 
 	static const int kMaxQueueLength = 10000;
 };
@@ -12,6 +12,75 @@ void xop::Free(void *ptr)
 	return MemoryManager::Instance().Free(ptr);
 }
 
+std::shared_ptr<char> xop::AllocBuffer(uint32_t size)
+{
+	return std::shared_ptr<char>((char*)xop::Alloc(size), xop::Free);
+}
+
+namespace xop
+{
+
+// 共享内存池前面的线程本地空闲链表: 常见的分配/释放不加锁, 每一批才加一次池的锁
+struct ThreadCache
+{
+	static const uint32_t kBatchSize = 16;
+	static const uint32_t kMaxCached = 64;
+
+	MemoryBlock* head[MemoryManager::kMaxMemoryPool] = {};
+	uint32_t count[MemoryManager::kMaxMemoryPool] = {};
+
+	~ThreadCache()
+	{
+		for (int n = 0; n < MemoryManager::kMaxMemoryPool; n++) {
+			if (head[n] != nullptr) {
+				MemoryBlock* tail = head[n];
+				while (tail->next != nullptr) {
+					tail = tail->next;
+				}
+				head[n]->pool->FreeBatch(head[n], tail, count[n]);
+			}
+		}
+	}
+
+	void* Alloc(MemoryPool& pool, int index)
+	{
+		if (head[index] == nullptr) {
+			count[index] = pool.AllocBatch(&head[index], kBatchSize);
+			if (count[index] == 0) {
+				return nullptr;
+			}
+		}
+
+		MemoryBlock* block = head[index];
+		head[index] = block->next;
+		count[index]--;
+		return ((char*)block + sizeof(MemoryBlock));
+	}
+
+	void Free(MemoryBlock* block, int index)
+	{
+		block->next = head[index];
+		head[index] = block;
+		count[index]++;
+
+		if (count[index] > kMaxCached) {
+			MemoryBlock* first = head[index];
+			MemoryBlock* last = first;
+			for (uint32_t n = 1; n < kBatchSize; n++) {
+				last = last->next;
+			}
+			head[index] = last->next;
+			last->next = nullptr;
+			count[index] -= kBatchSize;
+			block->pool->FreeBatch(first, last, kBatchSize);
+		}
+	}
+};
+
+static thread_local ThreadCache t_cache;
+
+}
+
 MemoryPool::MemoryPool()
 {
 
@@ -32,6 +101,7 @@ void MemoryPool::Init(uint32_t size, uint32_t n)
 
 	block_size_ = size;
 	num_blocks_ = n;
+	free_blocks_ = n;
 	memory_ = (char*)malloc(num_blocks_ * (block_size_ + sizeof(MemoryBlock)));
 	head_ = (MemoryBlock*)memory_;
 	head_->block_id = 1;
@@ -56,6 +126,7 @@ void* MemoryPool::Alloc(uint32_t size)
 	if (head_ != nullptr) {
 		MemoryBlock* block = head_;
 		head_ = head_->next;
+		free_blocks_--;
 		return ((char*)block + sizeof(MemoryBlock));
 	}
 
@@ -69,15 +140,62 @@ void MemoryPool::Free(void* ptr)
 		std::lock_guard<std::mutex> locker(mutex_);
 		block->next = head_;
 		head_ = block;
+		free_blocks_++;
 	}
 }
 
+uint32_t MemoryPool::AllocBatch(MemoryBlock** head, uint32_t n)
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	if (head_ == nullptr) {
+		return 0;
+	}
+
+	uint32_t count = 1;
+	MemoryBlock* tail = head_;
+	while (count < n && tail->next != nullptr) {
+		tail = tail->next;
+		count++;
+	}
+
+	*head = head_;
+	head_ = tail->next;
+	tail->next = nullptr;
+	free_blocks_ -= count;
+	refills_++;
+	return count;
+}
+
+void MemoryPool::FreeBatch(MemoryBlock* head, MemoryBlock* tail, uint32_t n)
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	tail->next = head_;
+	head_ = head;
+	free_blocks_ += n;
+}
+
+MemoryPoolStats MemoryPool::GetStats()
+{
+	MemoryPoolStats stats;
+	stats.block_size = block_size_;
+	stats.num_blocks = num_blocks_;
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stats.free_blocks = free_blocks_;
+	}
+	stats.refills = refills_;
+	stats.exhausted = exhausted_;
+	return stats;
+}
+
 MemoryManager::MemoryManager()
 {
-	memory_pools_[0].Init(4096, 50);
-	memory_pools_[1].Init(40960, 10);
-	memory_pools_[2].Init(102400, 5);
-	//memory_pools_[3].Init(204800, 2);
+	// RTP 包在每帧一块的 RtpPacketArena 中, 块按帧大小分档; 数量按帧环保留的帧数 (RtpFrameRing::kMaxFrames) 估算
+	memory_pools_[0].Init(2048, 512);      // RTSP 消息, 静止画面的保活帧
+	memory_pools_[1].Init(4096, 64);       // RTSP 消息, 小的 P 帧
+	memory_pools_[2].Init(32768, 160);     // 一般的 P 帧
+	memory_pools_[3].Init(131072, 40);     // 大的 P 帧, 较小的 I 帧
+	memory_pools_[4].Init(524288, 8);      // I 帧
 }
 
 MemoryManager::~MemoryManager()
@@ -95,16 +213,19 @@ void* MemoryManager::Alloc(uint32_t size)
 {
 	for (int n = 0; n < kMaxMemoryPool; n++) {
 		if (size <= memory_pools_[n].BolckSize()) {
-			void* ptr = memory_pools_[n].Alloc(size);
+			MemoryPool& pool = memory_pools_[n];
+			void* ptr = pool.IsThreadCached() ? t_cache.Alloc(pool, n) : pool.Alloc(size);
 			if (ptr != nullptr) {
 				return ptr;
-			}				
+			}
 			else {
+				memory_pools_[n].exhausted_++;
 				break;
 			}
 		}
-	} 
+	}
 
+	malloc_count_++;
 	MemoryBlock *block = (MemoryBlock*)malloc(size + sizeof(MemoryBlock));
 	block->block_id = 0;
 	block->pool = nullptr;
@@ -116,11 +237,25 @@ void MemoryManager::Free(void* ptr)
 {
 	MemoryBlock *block = (MemoryBlock*)((char*)ptr - sizeof(MemoryBlock));
 	MemoryPool *pool = block->pool;
-	
+
 	if (pool != nullptr && block->block_id > 0) {
-		pool->Free(ptr);
+		if (pool->IsThreadCached()) {
+			t_cache.Free(block, GetPoolIndex(pool));
+		}
+		else {
+			pool->Free(ptr);
+		}
 	}
 	else {
 		::free(block);
 	}
 }
+
+std::vector<MemoryPoolStats> MemoryManager::GetStats()
+{
+	std::vector<MemoryPoolStats> stats;
+	for (int n = 0; n < kMaxMemoryPool; n++) {
+		stats.push_back(memory_pools_[n].GetStats());
+	}
+	return stats;
+}
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 namespace xop
 {
@@ -12,6 +15,9 @@ namespace xop
 void* Alloc(uint32_t size);
 void Free(void *ptr);
 
+// 从内存池分配的缓冲, 最后一个引用释放时归还到池中
+std::shared_ptr<char> AllocBuffer(uint32_t size);
+
 class MemoryPool;
 
 struct MemoryBlock
@@ -21,6 +27,15 @@ struct MemoryBlock
 	MemoryBlock *next = nullptr;
 };
 
+struct MemoryPoolStats
+{
+	uint32_t block_size = 0;
+	uint32_t num_blocks = 0;
+	uint32_t free_blocks = 0;   // 共享空闲链表中的块数, 不含各线程缓存中的块
+	uint64_t refills = 0;       // 分批交给线程缓存的次数
+	uint64_t exhausted = 0;     // 池已用完而改用 malloc 的次数
+};
+
 class MemoryPool
 {
 public:
@@ -31,15 +46,28 @@ public:
 	void* Alloc(uint32_t size);
 	void  Free(void* ptr);
 
+	// 加一次锁, 在共享链表和线程缓存之间移动最多 n 个块
+	uint32_t AllocBatch(MemoryBlock** head, uint32_t n);
+	void FreeBatch(MemoryBlock* head, MemoryBlock* tail, uint32_t n);
+
 	size_t BolckSize() const
 	{ return block_size_; }
 
+	// 只有块多而小的池经过线程缓存; 大块本来就少, 缓存只会把它们滞留在某个线程里
+	bool IsThreadCached() const
+	{ return num_blocks_ >= 256; }
+
+	MemoryPoolStats GetStats();
+
 //private:
 	char* memory_ = nullptr;
 	uint32_t block_size_ = 0;
 	uint32_t num_blocks_ = 0;
+	uint32_t free_blocks_ = 0;
 	MemoryBlock* head_ = nullptr;
 	std::mutex mutex_;
+	std::atomic<uint64_t> refills_{0};
+	std::atomic<uint64_t> exhausted_{0};
 };
 
 class MemoryManager
@@ -51,11 +79,22 @@ public:
 	void* Alloc(uint32_t size);
 	void  Free(void* ptr);
 
+	std::vector<MemoryPoolStats> GetStats();
+
+	uint64_t GetMallocCount() const
+	{ return malloc_count_; }
+
+	static const int kMaxMemoryPool = 5;
+
 private:
+	friend struct ThreadCache;
 	MemoryManager();
 
-	static const int kMaxMemoryPool = 3;
+	int GetPoolIndex(const MemoryPool* pool) const
+	{ return (int)(pool - memory_pools_); }
+
 	MemoryPool memory_pools_[kMaxMemoryPool];
+	std::atomic<uint64_t> malloc_count_{0};
 };
 
 }
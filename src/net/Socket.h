@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #define SOCKET int
 #define INVALID_SOCKET  (-1)
 #define SOCKET_ERROR    (-1) 
@@ -6,7 +6,7 @@ using namespace xop;
 TcpConnection::TcpConnection(TaskScheduler *task_scheduler, SOCKET sockfd)
 	: task_scheduler_(task_scheduler)
 	, read_buffer_(new BufferReader)
-	, write_buffer_(new BufferWriter(500))
+	, write_buffer_(new BufferWriter(kMaxQueuedPackets))
 	, channel_(new Channel(sockfd))
 {
 	is_closed_ = false;
@@ -54,6 +54,34 @@ void TcpConnection::Send(const char *data, uint32_t size)
 	}
 }
 
+bool TcpConnection::Send(const char *header, uint32_t header_size, std::shared_ptr<char> data, uint32_t size, uint32_t index, bool more)
+{
+	if (is_closed_) {
+		return false;
+	}
+
+	mutex_.lock();
+	bool ret = write_buffer_->Append(header, header_size, data, size, index);
+	bool pending = more && ret && write_buffer_->Size() < kMaxPendingPackets;
+	write_buffer_->SetMore(more && ret);
+	mutex_.unlock();
+
+	if (!pending) {
+		this->HandleWrite();
+	}
+	return ret;
+}
+
+bool TcpConnection::ReserveQueue(uint32_t count)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!write_buffer_->IsEmpty() && !write_buffer_->CanAppend(count)) {
+		return false;
+	}
+	write_buffer_->Reserve(count);
+	return true;
+}
+
 void TcpConnection::Disconnect()
 {
 	std::lock_guard<std::mutex> lock(mutex_);
@@ -101,6 +129,7 @@ void TcpConnection::HandleWrite()
 
 	int ret = 0;
 	bool empty = false;
+	bool drained = false;
 	do
 	{
 		ret = write_buffer_->Send(channel_->GetSocket());
@@ -114,8 +143,10 @@ void TcpConnection::HandleWrite()
 
 	if (empty) {
 		if (channel_->IsWriting()) {
+			// 之前写不完而等待可写事件, 现在积压已清空
 			channel_->DisableWriting();
 			task_scheduler_->UpdateChannel(channel_);
+			drained = true;
 		}
 	}
 	else if(!channel_->IsWriting()) {
@@ -124,6 +155,10 @@ void TcpConnection::HandleWrite()
 	}
 
 	mutex_.unlock();
+
+	if (drained && write_complete_cb_) {
+		write_complete_cb_(shared_from_this());
+	}
 }
 
 void TcpConnection::Close()
@@ -19,6 +19,10 @@ public:
 	using DisconnectCallback = std::function<void(std::shared_ptr<TcpConnection> conn)> ;
 	using CloseCallback = std::function<void(std::shared_ptr<TcpConnection> conn)>;
 	using ReadCallback = std::function<bool(std::shared_ptr<TcpConnection> conn, xop::BufferReader& buffer)>;
+	using WriteCompleteCallback = std::function<void(std::shared_ptr<TcpConnection> conn)>;
+
+	// 发送队列最多缓存的包数
+	static const uint32_t kMaxQueuedPackets = 500;
 
 	TcpConnection(TaskScheduler *task_scheduler, SOCKET sockfd);
 	virtual ~TcpConnection();
@@ -32,8 +36,19 @@ public:
 	void SetCloseCallback(const CloseCallback& cb)
 	{ close_cb_ = cb; }
 
+	// 积压的发送队列全部写出时调用 (在所属调度线程中), 用于继续发送因队列满而暂停的数据
+	void SetWriteCompleteCallback(const WriteCompleteCallback& cb)
+	{ write_complete_cb_ = cb; }
+
 	void Send(std::shared_ptr<char> data, uint32_t size);
 	void Send(const char *data, uint32_t size);
+	// more 为 true 表示这一帧后面还有包: 只排队, 攒够一定数量再 (带 MSG_MORE) 写出; 帧的最后一个包把剩余的全部写出.
+	// 连接已关闭或发送队列已满时返回 false
+	bool Send(const char *header, uint32_t header_size, std::shared_ptr<char> data, uint32_t size, uint32_t index, bool more = false);
+
+	// 发送队列放得下 count 个包时为这一帧预留位置并返回 true. 队列为空时总是接纳, 超出队列上限的部分也预留,
+	// 避免比队列还大的帧永远发不出去或被截断
+	bool ReserveQueue(uint32_t count);
     
 	void Disconnect();
 
@@ -66,6 +81,8 @@ protected:
 	std::atomic_bool is_closed_;
 
 private:
+	static const uint32_t kMaxPendingPackets = 64;
+
 	void Close();
 
 	std::shared_ptr<xop::Channel> channel_;
@@ -73,6 +90,7 @@ private:
 	DisconnectCallback disconnect_cb_;
 	CloseCallback close_cb_;
 	ReadCallback read_cb_;
+	WriteCompleteCallback write_complete_cb_;
 };
 
 }
@@ -0,0 +1,7 @@
+// 颜色转换自检：SIMD 实现与标量实现逐位一致，标量实现与 swscale 的误差不超过上限
+#include "ColorConverter.h"
+
+int main()
+{
+    return ColorConverter::self_test() ? 0 : 1;
+}
@@ -81,7 +81,7 @@ string AACSource::GetAttribute()  // RFC 3640
 
 
 
-bool AACSource::HandleFrame(MediaChannelId channel_id, AVFrame frame)
+bool AACSource::PacketizeFrame(MediaChannelId channel_id, AVFrame frame, std::vector<RtpPacket>& pkts)
 {
 	if (frame.size > (MAX_RTP_PAYLOAD_SIZE-AU_SIZE)) {
 		return false;
@@ -101,22 +101,22 @@ bool AACSource::HandleFrame(MediaChannelId channel_id, AVFrame frame)
 	AU[2] = (frame_size & 0x1fe0) >> 5;
 	AU[3] = (frame_size & 0x1f) << 3;
 
-	RtpPacket rtp_pkt;
-	rtp_pkt.type = frame.type;
-	rtp_pkt.timestamp = frame.timestamp;
-	rtp_pkt.size = frame_size + 4 + RTP_HEADER_SIZE + AU_SIZE;
-	rtp_pkt.last = 1;
+	uint32_t pkt_size = frame_size + 4 + RTP_HEADER_SIZE + AU_SIZE;
+	RtpPacketArena arena(pkt_size);
+	uint8_t* payload = arena.Reserve(pkt_size) + 4 + RTP_HEADER_SIZE;
 
-	rtp_pkt.data.get()[4 + RTP_HEADER_SIZE + 0] = AU[0];
-	rtp_pkt.data.get()[4 + RTP_HEADER_SIZE + 1] = AU[1];
-	rtp_pkt.data.get()[4 + RTP_HEADER_SIZE + 2] = AU[2];
-	rtp_pkt.data.get()[4 + RTP_HEADER_SIZE + 3] = AU[3];
+	payload[0] = AU[0];
+	payload[1] = AU[1];
+	payload[2] = AU[2];
+	payload[3] = AU[3];
 
-	memcpy(rtp_pkt.data.get()+4+RTP_HEADER_SIZE+AU_SIZE, frame_buf, frame_size);
+	memcpy(payload + AU_SIZE, frame_buf, frame_size);
 
-	if (send_frame_callback_) {
-		send_frame_callback_(channel_id, rtp_pkt);
-	}
+	RtpPacket rtp_pkt = arena.Commit(pkt_size);
+	rtp_pkt.type = frame.type;
+	rtp_pkt.timestamp = frame.timestamp;
+	rtp_pkt.last = 1;
+	pkts.push_back(std::move(rtp_pkt));
 
 	return true;
 }
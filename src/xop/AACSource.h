@@ -26,7 +26,7 @@ public:
 
     virtual std::string GetAttribute();
 
-    bool HandleFrame(MediaChannelId channel_id, AVFrame frame);
+    virtual bool PacketizeFrame(MediaChannelId channel_id, AVFrame frame, std::vector<RtpPacket>& pkts);
 
     static uint32_t GetTimestamp(uint32_t samplerate =44100);
 
@@ -1,72 +1,128 @@
 ﻿#include "H264Parser.h"
 #include <cstring>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define XOP_H264_PARSER_SSE2
+#endif
+
 using namespace xop;
 
 Nal H264Parser::findNal(const uint8_t *data, uint32_t size)
 {
     Nal nal(nullptr, nullptr);
 
-    if(size < 5)
+    const uint8_t *pos = data;
+    const uint8_t *nal_begin = nullptr;
+    uint32_t nal_size = 0;
+    if (!nextNal(&pos, data + size, &nal_begin, &nal_size))
     {
         return nal;
     }
 
-    nal.second = const_cast<uint8_t*>(data) + (size-1);
+    nal.first = const_cast<uint8_t*>(nal_begin);
+    nal.second = const_cast<uint8_t*>(nal_begin) + (nal_size - 1);
+    return nal;
+}
 
-    uint32_t startCode = 0;
-    uint32_t pos = 0;
-    uint8_t prefix[3] = {0};
-    memcpy(prefix, data, 3);
-    size -= 3;
-    data += 2;
+const uint8_t* H264Parser::findStartCodeScalar(const uint8_t *data, const uint8_t *end)
+{
+    // memchr 找 0x01, 再回头检查前两个字节是否为 00 00
+    const uint8_t *p = data + 2;
+    while (p < end)
+    {
+        p = static_cast<const uint8_t*>(memchr(p, 0x01, end - p));
+        if (p == nullptr)
+        {
+            return end;
+        }
+        if (p[-1] == 0 && p[-2] == 0)
+        {
+            return p - 2;
+        }
+        // 后面两个字节的前缀都包含这个 0x01, 不可能是起始码
+        p += 3;
+    }
+    return end;
+}
+
+const uint8_t* H264Parser::findStartCode(const uint8_t *data, const uint8_t *end, uint32_t *start_code_size)
+{
+    const uint8_t *p = data;
+    const uint8_t *found = end;
 
-    while(size--)
+    if (end - data >= 3)
     {
-        if ((prefix[pos % 3] == 0) && (prefix[(pos + 1) % 3] == 0) && (prefix[(pos + 2) % 3] == 1))
+#ifdef XOP_H264_PARSER_SSE2
+        // 一次比较 16 个位置: p[i] == 0 && p[i+1] == 0 && p[i+2] == 1
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        while (end - p >= 18)
         {
-            if(nal.first == nullptr) // 00 00 01 
+            __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+            __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2));
+            __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+                                        _mm_cmpeq_epi8(b2, one));
+            int mask = _mm_movemask_epi8(hit);
+            if (mask != 0)
             {
-                nal.first = const_cast<uint8_t*>(data) + 1;
-                startCode = 3;
-            }
-            else if(startCode == 3)
-            {
-                nal.second = const_cast<uint8_t*>(data) - 3;
+                found = p + __builtin_ctz(mask);
                 break;
-            }               
+            }
+            p += 16;
         }
-        else if ((prefix[pos % 3] == 0) && (prefix[(pos + 1) % 3] == 0) && (prefix[(pos + 2) % 3] == 0))
+        if (found == end)
         {
-            if (*(data+1) == 0x01) // 00 00 00 01 
-            {              
-                if(nal.first == nullptr)
-                {
-                    if(size >= 1)
-                    {
-                        nal.first = const_cast<uint8_t*>(data) + 2;
-                    }                       
-                    else
-                    {
-                        break;  
-                    }                  
-                    startCode = 4;
-                }
-                else if(startCode == 4)
-                {
-                    nal.second = const_cast<uint8_t*>(data) - 3;
-                    break;
-                }                    
-            }
+            found = findStartCodeScalar(p, end);
         }
+#else
+        found = findStartCodeScalar(p, end);
+#endif
+    }
 
-        prefix[(pos++) % 3] = *(++data);
+    if (found == end)
+    {
+        return end;
     }
-        
-    if(nal.first == nullptr)
-        nal.second = nullptr;
 
-    return nal;
+    // 00 00 00 01: 把前面的 0 也算进起始码, 否则它会被当成上一个 NAL 的结尾
+    uint32_t size = 3;
+    if (found > data && found[-1] == 0)
+    {
+        found--;
+        size = 4;
+    }
+
+    if (start_code_size)
+    {
+        *start_code_size = size;
+    }
+    return found;
 }
 
+bool H264Parser::nextNal(const uint8_t **data, const uint8_t *end, const uint8_t **nal, uint32_t *nal_size)
+{
+    uint32_t start_code_size = 0;
+    const uint8_t *start = findStartCode(*data, end, &start_code_size);
+    if (start == end)
+    {
+        *data = end;
+        return false;
+    }
+
+    const uint8_t *nal_begin = start + start_code_size;
+    const uint8_t *nal_end = findStartCode(nal_begin, end);
+    *data = nal_end;
+
+    if (nal_end == nal_begin)
+    {
+        // 空 NAL (连续的起始码), 跳过
+        return nextNal(data, end, nal, nal_size);
+    }
+
+    *nal = nal_begin;
+    *nal_size = static_cast<uint32_t>(nal_end - nal_begin);
+    return true;
+}
 
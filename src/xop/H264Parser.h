@@ -1,8 +1,8 @@
 ﻿#ifndef XOP_H264_PARSER_H
 #define XOP_H264_PARSER_H
 
-#include <cstdint> 
-#include <utility> 
+#include <cstdint>
+#include <utility>
 
 namespace xop
 {
@@ -11,14 +11,22 @@ typedef std::pair<uint8_t*, uint8_t*> Nal; // <nal begin, nal end>
 
 class H264Parser
 {
-public:    
+public:
+    // 返回第一个 NAL, nal.second 指向 NAL 的最后一个字节
     static Nal findNal(const uint8_t *data, uint32_t size);
-        
-private:
-  
+
+    // 在 [data, end) 中查找下一个 Annex-B 起始码, 返回起始码首字节的位置, 找不到返回 end
+    // start_code_size 输出起始码长度 (00 00 01 为 3, 00 00 00 01 为 4)
+    static const uint8_t* findStartCode(const uint8_t *data, const uint8_t *end, uint32_t *start_code_size = nullptr);
+
+    // 从 *data 开始取出下一个 NAL (不含起始码), 并把 *data 移到下一个起始码处; 没有更多 NAL 时返回 false
+    static bool nextNal(const uint8_t **data, const uint8_t *end, const uint8_t **nal, uint32_t *nal_size);
+
+    // 不用 SIMD 的查找 (memchr), 返回 00 00 01 的位置, 找不到返回 end; 没有 SSE2 时 findStartCode 用它, 基准测试也用来对比
+    static const uint8_t* findStartCodeScalar(const uint8_t *data, const uint8_t *end);
 };
-    
+
 }
 
-#endif 
+#endif
 
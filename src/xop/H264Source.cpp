@@ -8,7 +8,10 @@
 #endif
 
 #include "H264Source.h"
+#include "H264Parser.h"
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <chrono>
 #if defined(__linux) || defined(__linux__)
 #include <sys/time.h>
@@ -42,86 +45,221 @@ string H264Source::GetMediaDescription(uint16_t port)
     return string(buf);
 }
 
+static string Base64Encode(const uint8_t* data, uint32_t size)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    string out;
+    out.reserve((size + 2) / 3 * 4);
+    for (uint32_t i = 0; i < size; i += 3) {
+        uint32_t n = data[i] << 16;
+        if (i + 1 < size) n |= data[i + 1] << 8;
+        if (i + 2 < size) n |= data[i + 2];
+        out.push_back(table[(n >> 18) & 0x3f]);
+        out.push_back(table[(n >> 12) & 0x3f]);
+        out.push_back(i + 1 < size ? table[(n >> 6) & 0x3f] : '=');
+        out.push_back(i + 2 < size ? table[n & 0x3f] : '=');
+    }
+    return out;
+}
+
 string H264Source::GetAttribute()
 {
-    return string("a=rtpmap:96 H264/90000");
+    // FU-A 和 STAP-A 需要 packetization-mode=1 (非交错模式)
+    string attr = "a=rtpmap:96 H264/90000\r\na=fmtp:96 packetization-mode=1";
+
+    std::lock_guard<std::mutex> lock(param_mutex_);
+    if (sps_.size() >= 4 && !pps_.empty()) {
+        char profile_level_id[8] = {0};
+        snprintf(profile_level_id, sizeof(profile_level_id), "%02X%02X%02X", sps_[1], sps_[2], sps_[3]);
+        attr += ";profile-level-id=";
+        attr += profile_level_id;
+        attr += ";sprop-parameter-sets=";
+        attr += Base64Encode(sps_.data(), (uint32_t)sps_.size());
+        attr += ",";
+        attr += Base64Encode(pps_.data(), (uint32_t)pps_.size());
+    }
+    return attr;
 }
 
-bool H264Source::HandleFrame(MediaChannelId channel_id, AVFrame frame)
+void H264Source::SetParameterSets(const uint8_t* sps, uint32_t sps_size, const uint8_t* pps, uint32_t pps_size)
 {
-    uint8_t* frame_buf  = frame.buffer.get();
-    uint32_t frame_size = frame.size;
+    std::lock_guard<std::mutex> lock(param_mutex_);
+    sps_.assign(sps, sps + sps_size);
+    pps_.assign(pps, pps + pps_size);
+}
+
+bool H264Source::PacketizeFrame(MediaChannelId channel_id, AVFrame frame, std::vector<RtpPacket>& pkts)
+{
+    const uint8_t* frame_buf = frame.buffer.get();
+    const uint8_t* frame_end = frame_buf + frame.size;
 
     if (frame.timestamp == 0) {
-	    frame.timestamp = GetTimestamp();
-    }    
-
-    if (frame_size <= MAX_RTP_PAYLOAD_SIZE) {
-        RtpPacket rtp_pkt;
-	    rtp_pkt.type = frame.type;
-	    rtp_pkt.timestamp = frame.timestamp;
-	    rtp_pkt.size = frame_size + 4 + RTP_HEADER_SIZE;
-	    rtp_pkt.last = 1;
-        memcpy(rtp_pkt.data.get()+4+RTP_HEADER_SIZE, frame_buf, frame_size); 
-
-        if (send_frame_callback_) {
-		    if (!send_frame_callback_(channel_id, rtp_pkt)) {
-			    return false;
-		    }               
+        frame.timestamp = GetTimestamp();
+    }
+
+    // 按帧大小估算所有包需要的空间: 负载 + 每个分片的 RTP 头和 FU 头, 再给少量小 NAL 留余量
+    const uint32_t overhead = RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + 2;
+    RtpPacketArena arena(frame.size + (frame.size / (MAX_RTP_PAYLOAD_SIZE - 2) + 8) * overhead);
+
+    // Annex-B 访问单元按起始码拆成单独的 NAL 分别打包, marker 只标记在最后一个 NAL 的最后一个包上
+    const uint8_t* pos = frame_buf;
+    const uint8_t* nal_pos = pos;
+    const uint8_t* nal = nullptr;
+    uint32_t nal_size = 0;
+    if (!H264Parser::nextNal(&pos, frame_end, &nal, &nal_size)) {
+        // 没有起始码, 整帧当作一个 NAL
+        PacketizeNal(arena, frame, frame_buf, frame.size, true, pkts);
+        return true;
+    }
+
+    // 连续的小 NAL (SPS/PPS/SEI, 静止画面的小切片) 聚合成 STAP-A 包, 放不下的 NAL 单独打包或 FU-A 分片
+    StapA stap;
+    while (true) {
+        const uint8_t* next_nal_pos = pos;
+        const uint8_t* next_nal = nullptr;
+        uint32_t next_nal_size = 0;
+        bool has_next = H264Parser::nextNal(&pos, frame_end, &next_nal, &next_nal_size);
+        bool last_nal = !has_next;
+
+        if (1 + 2 + nal_size <= MAX_RTP_PAYLOAD_SIZE) {
+            if (stap.count > 0 && stap.size + 2 + nal_size > MAX_RTP_PAYLOAD_SIZE) {
+                FlushStapA(arena, frame, stap, false, pkts);
+            }
+            AppendStapA(stap, nal_pos, nal, nal_size);
+            if (last_nal) {
+                FlushStapA(arena, frame, stap, true, pkts);
+            }
+        }
+        else {
+            FlushStapA(arena, frame, stap, false, pkts);
+            PacketizeNal(arena, frame, nal, nal_size, last_nal, pkts);
         }
+
+        if (!has_next) {
+            break;
+        }
+        nal_pos = next_nal_pos;
+        nal = next_nal;
+        nal_size = next_nal_size;
+    }
+
+    return true;
+}
+
+void H264Source::AppendStapA(StapA& stap, const uint8_t* nal_pos, const uint8_t* nal, uint32_t nal_size)
+{
+    // 这里只记账, 数据在 FlushStapA 时才写入; 一个 STAP-A 中的 NAL 在帧里是连续的, 可以从 begin 重新取出
+    if (stap.count == 0) {
+        stap.begin = nal_pos;
+        stap.first_nal = nal;
+        stap.first_nal_size = nal_size;
+        stap.header = nal[0] & 0xE0;
+        stap.size = 1;
     }
     else {
-        char FU_A[2] = {0};
+        // STAP-A 头: F 取各 NAL 的或, NRI 取最大值
+        uint8_t f = (stap.header | nal[0]) & 0x80;
+        uint8_t nri = std::max<uint8_t>(stap.header & 0x60, nal[0] & 0x60);
+        stap.header = f | nri;
+    }
+    stap.size += 2 + nal_size;
+    stap.count++;
+}
 
-        FU_A[0] = (frame_buf[0] & 0xE0) | 28;
-        FU_A[1] = 0x80 | (frame_buf[0] & 0x1f);
+void H264Source::FlushStapA(RtpPacketArena& arena, const AVFrame& frame, StapA& stap, bool last_nal,
+                            std::vector<RtpPacket>& pkts)
+{
+    if (stap.count == 0) {
+        return;
+    }
 
-        frame_buf  += 1;
-        frame_size -= 1;
+    if (stap.count == 1) {
+        // 只有一个 NAL 时不聚合
+        stap.count = 0;
+        PacketizeNal(arena, frame, stap.first_nal, stap.first_nal_size, last_nal, pkts);
+        return;
+    }
 
-        while (frame_size + 2 > MAX_RTP_PAYLOAD_SIZE) {
-            RtpPacket rtp_pkt;
-            rtp_pkt.type = frame.type;
-            rtp_pkt.timestamp = frame.timestamp;
-            rtp_pkt.size = 4 + RTP_HEADER_SIZE + MAX_RTP_PAYLOAD_SIZE;
-            rtp_pkt.last = 0;
+    uint32_t pkt_size = RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + stap.size;
+    uint8_t* payload = arena.Reserve(pkt_size) + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+    uint32_t offset = 0;
+    payload[offset++] = stap.header | 24;
 
-            rtp_pkt.data.get()[RTP_HEADER_SIZE+4] = FU_A[0];
-            rtp_pkt.data.get()[RTP_HEADER_SIZE+5] = FU_A[1];
-            memcpy(rtp_pkt.data.get()+4+RTP_HEADER_SIZE+2, frame_buf, MAX_RTP_PAYLOAD_SIZE-2);
+    const uint8_t* pos = stap.begin;
+    const uint8_t* end = frame.buffer.get() + frame.size;
+    const uint8_t* nal = nullptr;
+    uint32_t nal_size = 0;
+    for (uint32_t i = 0; i < stap.count && H264Parser::nextNal(&pos, end, &nal, &nal_size); i++) {
+        payload[offset++] = (uint8_t)(nal_size >> 8);
+        payload[offset++] = (uint8_t)(nal_size & 0xff);
+        memcpy(payload + offset, nal, nal_size);
+        offset += nal_size;
+    }
 
-            if (send_frame_callback_) {
-                if (!send_frame_callback_(channel_id, rtp_pkt))
-                    return false;
-            }
+    RtpPacket rtp_pkt = arena.Commit(pkt_size);
+    rtp_pkt.type = frame.type;
+    rtp_pkt.timestamp = frame.timestamp;
+    rtp_pkt.last = last_nal ? 1 : 0;
+    pkts.push_back(std::move(rtp_pkt));
 
-            frame_buf  += MAX_RTP_PAYLOAD_SIZE - 2;
-            frame_size -= MAX_RTP_PAYLOAD_SIZE - 2;
+    stap.count = 0;
+    stap.size = 0;
+}
 
-            FU_A[1] &= ~0x80;
-        }
+void H264Source::PacketizeNal(RtpPacketArena& arena, const AVFrame& frame, const uint8_t* nal, uint32_t nal_size,
+                              bool last_nal, std::vector<RtpPacket>& pkts)
+{
+    if (nal_size == 0) {
+        return;
+    }
 
-        {
-            RtpPacket rtp_pkt;
-            rtp_pkt.type = frame.type;
-            rtp_pkt.timestamp = frame.timestamp;
-            rtp_pkt.size = 4 + RTP_HEADER_SIZE + 2 + frame_size;
-            rtp_pkt.last = 1;
+    if (nal_size <= MAX_RTP_PAYLOAD_SIZE) {
+        uint32_t pkt_size = nal_size + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+        memcpy(arena.Reserve(pkt_size) + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE, nal, nal_size);
 
+        RtpPacket rtp_pkt = arena.Commit(pkt_size);
+        rtp_pkt.type = frame.type;
+        rtp_pkt.timestamp = frame.timestamp;
+        rtp_pkt.last = last_nal ? 1 : 0;
+        pkts.push_back(std::move(rtp_pkt));
+        return;
+    }
+
+    uint8_t FU_A[2] = {0};
+
+    FU_A[0] = (nal[0] & 0xE0) | 28;
+    FU_A[1] = 0x80 | (nal[0] & 0x1f);
+
+    nal      += 1;
+    nal_size -= 1;
+
+    while (nal_size > 0) {
+        uint32_t fragment_size = nal_size;
+        if (fragment_size + 2 > MAX_RTP_PAYLOAD_SIZE) {
+            fragment_size = MAX_RTP_PAYLOAD_SIZE - 2;
+        }
+        else {
             FU_A[1] |= 0x40;
-            rtp_pkt.data.get()[RTP_HEADER_SIZE+4] = FU_A[0];
-            rtp_pkt.data.get()[RTP_HEADER_SIZE+5] = FU_A[1];
-            memcpy(rtp_pkt.data.get()+4+RTP_HEADER_SIZE+2, frame_buf, frame_size);
-
-            if (send_frame_callback_) {
-			    if (!send_frame_callback_(channel_id, rtp_pkt)) {
-				    return false;
-			    }              
-            }
         }
-    }
 
-    return true;
+        uint32_t pkt_size = RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + 2 + fragment_size;
+        uint8_t* payload = arena.Reserve(pkt_size) + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+        payload[0] = FU_A[0];
+        payload[1] = FU_A[1];
+        memcpy(payload + 2, nal, fragment_size);
+
+        RtpPacket rtp_pkt = arena.Commit(pkt_size);
+        rtp_pkt.type = frame.type;
+        rtp_pkt.timestamp = frame.timestamp;
+        rtp_pkt.last = (last_nal && (FU_A[1] & 0x40)) ? 1 : 0;
+        pkts.push_back(std::move(rtp_pkt));
+
+        nal      += fragment_size;
+        nal_size -= fragment_size;
+
+        FU_A[1] &= ~0x80;
+    }
 }
 
 uint32_t H264Source::GetTimestamp()
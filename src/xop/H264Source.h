@@ -6,6 +6,8 @@
 
 #include "MediaSource.h"
 #include "rtp.h"
+#include <mutex>
+#include <vector>
 
 namespace xop
 { 
@@ -26,14 +28,39 @@ public:
 
 	virtual std::string GetAttribute(); 
 
-	bool HandleFrame(MediaChannelId channel_id, AVFrame frame);
+	/* 设置 SDP 中的 profile-level-id 和 sprop-parameter-sets, 参数为不含起始码的 SPS/PPS */
+	void SetParameterSets(const uint8_t* sps, uint32_t sps_size, const uint8_t* pps, uint32_t pps_size);
+
+	virtual bool PacketizeFrame(MediaChannelId channel_id, AVFrame frame, std::vector<RtpPacket>& pkts);
 
 	static uint32_t GetTimestamp();
 	
 private:
 	H264Source(uint32_t framerate);
 
+	// 正在聚合的 STAP-A 包 (RFC 6184 5.7.1)
+	struct StapA
+	{
+		const uint8_t* begin = nullptr; // 第一个 NAL 的起始码位置
+		uint32_t size = 0;   // STAP-A 负载长度, 含 1 字节 STAP-A 头
+		uint32_t count = 0;  // 已聚合的 NAL 个数
+		uint8_t header = 0;  // F 和 NRI 位
+		const uint8_t* first_nal = nullptr;
+		uint32_t first_nal_size = 0;
+	};
+
+	void AppendStapA(StapA& stap, const uint8_t* nal_pos, const uint8_t* nal, uint32_t nal_size);
+	void FlushStapA(RtpPacketArena& arena, const AVFrame& frame, StapA& stap, bool last_nal,
+	                std::vector<RtpPacket>& pkts);
+
+	void PacketizeNal(RtpPacketArena& arena, const AVFrame& frame, const uint8_t* nal, uint32_t nal_size,
+	                  bool last_nal, std::vector<RtpPacket>& pkts);
+
 	uint32_t framerate_ = 25;
+
+	std::mutex param_mutex_;
+	std::vector<uint8_t> sps_;
+	std::vector<uint8_t> pps_;
 };
 	
 }
@@ -6,7 +6,7 @@
 #include <cstring>
 #include <ctime>
 #include <map>
-#include <forward_list>
+#include <algorithm>
 #include "net/Logger.h"
 #include "net/SocketUtil.h"
 
@@ -18,7 +18,7 @@ std::atomic_uint MediaSession::last_session_id_(1);
 MediaSession::MediaSession(std::string url_suffxx)
 	: suffix_(url_suffxx)
 	, media_sources_(MAX_MEDIA_CHANNEL)
-	, buffer_(MAX_MEDIA_CHANNEL)
+	, frame_ring_(new RtpFrameRing())
 {
 	has_new_client_ = false;
 	session_id_ = ++last_session_id_;
@@ -50,55 +50,20 @@ void MediaSession::AddNotifyDisconnectedCallback(const NotifyDisconnectedCallbac
 	notify_disconnected_callbacks_.push_back(callback);
 }
 
-bool MediaSession::AddSource(MediaChannelId channel_id, MediaSource* source)
+void MediaSession::AddNotifyPlayCallback(const NotifyPlayCallback& callback)
 {
-	source->SetSendFrameCallback([this](MediaChannelId channel_id, RtpPacket pkt) {
-		std::forward_list<std::shared_ptr<RtpConnection>> clients;
-		std::map<int, RtpPacket> packets;
-		{
-			std::lock_guard<std::mutex> lock(map_mutex_);
-			for (auto iter = clients_.begin(); iter != clients_.end();) {
-				auto conn = iter->second.lock();
-				if (conn == nullptr) {
-					clients_.erase(iter++);
-				}
-				else  {				
-					int id = conn->GetId();
-					if (id >= 0) {
-						if (packets.find(id) == packets.end()) {
-							RtpPacket tmp_pkt;
-							memcpy(tmp_pkt.data.get(), pkt.data.get(), pkt.size);
-							tmp_pkt.size = pkt.size;
-							tmp_pkt.last = pkt.last;
-							tmp_pkt.timestamp = pkt.timestamp;
-							tmp_pkt.type = pkt.type;
-							packets.emplace(id, tmp_pkt);
-						}
-						clients.emplace_front(conn);
-					}
-					iter++;
-				}
-			}
-		}
-        
-		int count = 0;
-		for(auto iter : clients) {
-			int ret = 0;
-			int id = iter->GetId();
-			if (id >= 0) {
-				auto iter2 = packets.find(id);
-				if (iter2 != packets.end()) {
-					count++;
-					ret = iter->SendRtpPacket(channel_id, iter2->second);
-					if (is_multicast_ && ret == 0) {
-						break;
-					}				
-				}
-			}					
-		}
-		return true;
-		});
+	notify_play_callbacks_.push_back(callback);
+}
 
+void MediaSession::NotifyPlay(std::string peer_ip, uint16_t peer_port)
+{
+	for (auto& callback : notify_play_callbacks_) {
+		callback(session_id_, peer_ip, peer_port);
+	}
+}
+
+bool MediaSession::AddSource(MediaChannelId channel_id, MediaSource* source)
+{
 	media_sources_[channel_id].reset(source);
 	return true;
 }
@@ -109,27 +74,54 @@ bool MediaSession::RemoveSource(MediaChannelId channel_id)
 	return true;
 }
 
-bool MediaSession::StartMulticast()
+bool MediaSession::StartMulticast(const std::string& ip, uint16_t port, int ttl)
 {  
 	if (is_multicast_) {
 		return true;
 	}
 
-	multicast_ip_ = MulticastAddr::instance().GetAddr();
+	multicast_ip_ = (ip != "") ? ip : MulticastAddr::instance().GetAddr();
 	if (multicast_ip_ == "") {
 		return false;
 	}
 
-	std::random_device rd;
-	multicast_port_[channel_0] = htons(rd() & 0xfffe);
-	multicast_port_[channel_1] = htons(rd() & 0xfffe);
+	if (port == 0) {
+		std::random_device rd;
+		port = (uint16_t)((10000 + rd() % 50000) & 0xfffc);
+	}
+
+	multicast_sender_.reset(new RtpMulticastSender());
+	for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+		multicast_port_[chn] = port + 2 * chn;
+		if (!multicast_sender_->Open((MediaChannelId)chn, multicast_ip_, multicast_port_[chn], ttl)) {
+			LOG_ERROR("Could not open multicast socket for %s:%u.", multicast_ip_.c_str(), multicast_port_[chn]);
+			multicast_sender_.reset();
+			return false;
+		}
+	}
 
 	is_multicast_ = true;
 	return true;
 }
 
+MulticastStats MediaSession::GetMulticastStats()
+{
+	if (multicast_sender_) {
+		return multicast_sender_->GetStats();
+	}
+	return MulticastStats();
+}
+
+void MediaSession::ResetSdpMessage()
+{
+	std::lock_guard<std::mutex> lock(sdp_mutex_);
+	sdp_.clear();
+}
+
 std::string MediaSession::GetSdpMessage(std::string ip, std::string session_name)
 {
+	std::lock_guard<std::mutex> lock(sdp_mutex_);
+
 	if (sdp_ != "") {
 		return sdp_;
 	}
@@ -202,16 +194,131 @@ bool MediaSession::HandleFrame(MediaChannelId channel_id, AVFrame frame)
 {
 	std::lock_guard<std::mutex> lock(mutex_);
 
-	if(media_sources_[channel_id]) {
-		media_sources_[channel_id]->HandleFrame(channel_id, frame);
-	}
-	else {
+	if(!media_sources_[channel_id]) {
 		return false;
 	}
 
+	// 先把整帧打包, 再按调度线程成批发送
+	auto pkts = std::make_shared<std::vector<RtpPacket>>();
+	media_sources_[channel_id]->PacketizeFrame(channel_id, frame, *pkts);
+	if (!pkts->empty()) {
+		SendRtpPackets(channel_id, pkts);
+	}
+
+	return true;
+}
+
+bool MediaSession::SendRtpPackets(MediaChannelId channel_id, std::shared_ptr<std::vector<RtpPacket>> pkts)
+{
+	if (multicast_sender_) {
+		// 组播: 整帧只向组播地址发送一次, 与观看人数无关
+		multicast_sender_->Send(channel_id, (uint8_t)media_sources_[channel_id]->GetPayloadType(), *pkts);
+		return true;
+	}
+
+	// 包负载只打包一次写入环, 所有调度线程共享只读; 每个连接的 RTP 头在发送时单独生成
+	frame_ring_->Push(channel_id, pkts);
+
+	// 每个调度线程每帧只唤醒一次, 在自己的线程里让所属的客户端各自从读游标继续发送
+	std::shared_ptr<const ClientSnapshot> snapshot = std::atomic_load(&client_snapshot_);
+	if (snapshot == nullptr) {
+		return true;
+	}
+
+	std::shared_ptr<RtpFrameRing> ring = frame_ring_;
+	for (const ClientGroup& group : *snapshot) {
+		// 快照随任务一起持有, group 在任务执行期间一直有效
+		const ClientGroup* group_ptr = &group;
+		bool ret = group.scheduler->AddTriggerEvent([snapshot, group_ptr, ring] {
+			for (auto& weak_conn : group_ptr->conns) {
+				auto conn = weak_conn.lock();
+				if (conn == nullptr || conn->IsClosed()) {
+					continue;
+				}
+				conn->DeliverFrames(*ring);
+			}
+		});
+		if (!ret) {
+			// 帧仍在环中, 下一帧唤醒时一起补发
+			LOG_ERROR("Trigger event queue full, %u clients will catch up on the next frame.", (uint32_t)group.conns.size());
+		}
+	}
+
 	return true;
 }
 
+bool MediaSession::SendGopCache(std::shared_ptr<RtpConnection> rtp_conn)
+{
+	if (is_multicast_ || rtp_conn == nullptr) {
+		return false;
+	}
+
+	// 帧已经在环中打包好, 客户端只是从更早的游标开始逐帧发送, 不再为每个客户端重新打包整个 GOP;
+	// 推流暂停 (例如没有客户端时) 后缓存的画面已经过时, 不能再发给新客户端
+	size_t max_packets = rtp_conn->transport_mode_ == RTP_OVER_TCP ? TcpConnection::kMaxQueuedPackets : SIZE_MAX;
+	uint64_t seq = 0;
+	if (!frame_ring_->FindJoinPoint(kGopCacheMaxAgeMs, kMaxGopCacheFrames, max_packets, &seq)) {
+		return false;
+	}
+
+	return rtp_conn->StartFromFrame(*frame_ring_, seq);
+}
+
+bool MediaSession::HasGopCache()
+{
+	// 组播不能单独给某个客户端补发 GOP
+	if (is_multicast_) {
+		return false;
+	}
+
+	uint64_t seq = 0;
+	return frame_ring_->FindJoinPoint(kGopCacheMaxAgeMs, kMaxGopCacheFrames, TcpConnection::kMaxQueuedPackets, &seq);
+}
+
+PacerStats MediaSession::GetPacerStats()
+{
+	std::lock_guard<std::mutex> lock(map_mutex_);
+
+	PacerStats stats = retired_pacer_stats_;
+	for (auto& iter : clients_) {
+		auto conn = iter.second.lock();
+		if (conn) {
+			stats += conn->GetPacerStats();
+		}
+	}
+	return stats;
+}
+
+void MediaSession::UpdateClientSnapshot()
+{
+	// 调用者持有 map_mutex_
+	auto snapshot = std::make_shared<ClientSnapshot>();
+	for (auto iter = clients_.begin(); iter != clients_.end();) {
+		auto conn = iter->second.lock();
+		if (conn == nullptr) {
+			clients_.erase(iter++);
+			continue;
+		}
+		iter++;
+
+		TaskScheduler* scheduler = conn->GetTaskScheduler();
+		if (scheduler == nullptr) {
+			continue;
+		}
+		auto group = std::find_if(snapshot->begin(), snapshot->end(), [scheduler](const ClientGroup& g) {
+			return g.scheduler == scheduler;
+		});
+		if (group == snapshot->end()) {
+			snapshot->emplace_back();
+			group = snapshot->end() - 1;
+			group->scheduler = scheduler;
+		}
+		group->conns.push_back(conn);
+	}
+
+	std::atomic_store(&client_snapshot_, std::shared_ptr<const ClientSnapshot>(std::move(snapshot)));
+}
+
 bool MediaSession::AddClient(SOCKET rtspfd, std::shared_ptr<RtpConnection> rtp_conn)
 {
 	std::lock_guard<std::mutex> lock(map_mutex_);
@@ -219,11 +326,15 @@ bool MediaSession::AddClient(SOCKET rtspfd, std::shared_ptr<RtpConnection> rtp_c
 	auto iter = clients_.find (rtspfd);
 	if(iter == clients_.end()) {
 		std::weak_ptr<RtpConnection> rtp_conn_weak_ptr = rtp_conn;
+		rtp_conn->SetPacingRate(pacing_rate_);
+		rtp_conn->SetKeyFrameRequestCallback(key_frame_request_callback_);
+		rtp_conn->SetFrameRing(frame_ring_);
 		clients_.emplace(rtspfd, rtp_conn_weak_ptr);
 		for (auto& callback : notify_connected_callbacks_) {
 			callback(session_id_, rtp_conn->GetIp(), rtp_conn->GetPort());
 		}			
         
+		UpdateClientSnapshot();
 		has_new_client_ = true;
 		return true;
 	}
@@ -242,8 +353,10 @@ void MediaSession::RemoveClient(SOCKET rtspfd)
 			for (auto& callback : notify_disconnected_callbacks_) {
 				callback(session_id_, conn->GetIp(), conn->GetPort());
 			}				
+			retired_pacer_stats_ += conn->GetPacerStats();
 		}
 		clients_.erase(iter);
+		UpdateClientSnapshot();
 	}
 }
 
@@ -12,10 +12,14 @@
 #include <random>
 #include <cstdint>
 #include <unordered_set>
+#include <chrono>
 #include "media.h"
 #include "H264Source.h"
 #include "AACSource.h"
 #include "MediaSource.h"
+#include "RtpMulticastSender.h"
+#include "RtpPacer.h"
+#include "RtpFrameRing.h"
 #include "net/Socket.h"
 #include "net/RingBuffer.h"
 
@@ -23,6 +27,7 @@ namespace xop
 {
 
 class RtpConnection;
+class TaskScheduler;
 
 class MediaSession
 {
@@ -30,6 +35,8 @@ public:
 	using Ptr = std::shared_ptr<MediaSession>;
 	using NotifyConnectedCallback = std::function<void (MediaSessionId sessionId, std::string peer_ip, uint16_t peer_port)> ;
 	using NotifyDisconnectedCallback = std::function<void (MediaSessionId sessionId, std::string peer_ip, uint16_t peer_port)> ;
+	using NotifyPlayCallback = std::function<void (MediaSessionId sessionId, std::string peer_ip, uint16_t peer_port)> ;
+	using KeyFrameRequestCallback = std::function<void ()> ;
 
 	static MediaSession* CreateNew(std::string url_suffix="live");
 	virtual ~MediaSession();
@@ -37,10 +44,14 @@ public:
 	bool AddSource(MediaChannelId channel_id, MediaSource* source);
 	bool RemoveSource(MediaChannelId channel_id);
 
-	bool StartMulticast();
+	/* 组播地址为空时自动分配 (232.x.x.x), port 为 0 时随机选择; 通道 n 使用 port+2n 和 port+2n+1 (RTCP) */
+	bool StartMulticast(const std::string& ip = "", uint16_t port = 0, int ttl = 16);
 
 	void AddNotifyConnectedCallback(const NotifyConnectedCallback& callback);
 	void AddNotifyDisconnectedCallback(const NotifyDisconnectedCallback& callback);
+	void AddNotifyPlayCallback(const NotifyPlayCallback& callback);
+
+	void NotifyPlay(std::string peer_ip, uint16_t peer_port);
 
 	std::string GetRtspUrlSuffix() const
 	{ return suffix_; }
@@ -50,10 +61,18 @@ public:
 
 	std::string GetSdpMessage(std::string ip, std::string session_name ="");
 
+	/* 媒体参数 (如 SPS/PPS) 变化后调用, 下一次 DESCRIBE 重新生成 SDP */
+	void ResetSdpMessage();
+
 	MediaSource* GetMediaSource(MediaChannelId channel_id);
 
 	bool HandleFrame(MediaChannelId channel_id, AVFrame frame);
 
+	/* 让刚开始播放的客户端从环中缓存的最新关键帧开始接收 (在客户端所属的调度线程中调用), 没有可用缓存时返回 false */
+	bool SendGopCache(std::shared_ptr<RtpConnection> rtp_conn);
+
+	bool HasGopCache();
+
 	bool AddClient(SOCKET rtspfd, std::shared_ptr<RtpConnection> rtp_conn);
 	void RemoveClient(SOCKET rtspfd);
 
@@ -77,27 +96,76 @@ public:
 		return multicast_port_[channel_id];
 	}
 
+	MulticastStats GetMulticastStats();
+
+	/* 每个 UDP 客户端的发送速率上限 (bit/s), 0 表示不限速; 对之后加入的客户端生效 */
+	void SetPacingRate(uint64_t rate_bps)
+	{ pacing_rate_ = rate_bps; }
+
+	/* 客户端因拥塞丢帧、需要从关键帧重新开始时调用, 在客户端所属的调度线程中执行; 对之后加入的客户端生效 */
+	void SetKeyFrameRequestCallback(const KeyFrameRequestCallback& callback)
+	{
+		std::lock_guard<std::mutex> lock(map_mutex_);
+		key_frame_request_callback_ = callback;
+	}
+
+	/* 所有客户端 (包括已离开的) 的 pacer 统计之和 */
+	PacerStats GetPacerStats();
+
+	/* 客户端落后最新帧超过 ms 时整帧跳到最新的关键帧; 0 表示只在帧被环淘汰时才跳 */
+	void SetLatencyBudget(int ms)
+	{ frame_ring_->SetLatencyBudget(ms); }
+
+	FrameRingStats GetFrameRingStats() const
+	{ return frame_ring_->GetStats(); }
+
 private:
 	friend class MediaSource;
 	friend class RtspServer;
 	MediaSession(std::string url_suffxx);
+	/* 只由 HandleFrame 在持有 mutex_ 时调用, 一次一整帧, 帧环因此只有一个写入者 */
+	bool SendRtpPackets(MediaChannelId channel_id, std::shared_ptr<std::vector<RtpPacket>> pkts);
+	void UpdateClientSnapshot();
 
 	MediaSessionId session_id_ = 0;
 	std::string suffix_;
 	std::string sdp_;
+	std::mutex sdp_mutex_;
 
 	std::vector<std::unique_ptr<MediaSource>> media_sources_;
-	std::vector<RingBuffer<AVFrame>> buffer_;
+	/* 缓存的 GOP 就是 frame_ring_ 中最新的关键帧及其后的帧; 新客户端最多从 120 帧前开始 (不超过帧环的容量),
+	   TCP 客户端还要求整个 GOP 放得进一个连接的发送队列 */
+	static const size_t kMaxGopCacheFrames = 120;
+	static const int kGopCacheMaxAgeMs = 1000;
 
 	std::vector<NotifyConnectedCallback> notify_connected_callbacks_;
 	std::vector<NotifyDisconnectedCallback> notify_disconnected_callbacks_;
+	std::vector<NotifyPlayCallback> notify_play_callbacks_;
+	KeyFrameRequestCallback key_frame_request_callback_;
 	std::mutex mutex_;
 	std::mutex map_mutex_;
 	std::map<SOCKET, std::weak_ptr<RtpConnection>> clients_;
 
+	/* 客户端按调度线程分组后的只读快照, 只在 AddClient/RemoveClient 中重建 (写时复制),
+	   发送路径原子地取一份快照后无锁遍历 */
+	struct ClientGroup
+	{
+		TaskScheduler* scheduler = nullptr;
+		std::vector<std::weak_ptr<RtpConnection>> conns;
+	};
+	using ClientSnapshot = std::vector<ClientGroup>;
+	std::shared_ptr<const ClientSnapshot> client_snapshot_;
+
+	/* 单播的帧先写入环, 每个客户端按自己的读游标发送, 慢客户端不会拖住其他客户端 */
+	std::shared_ptr<RtpFrameRing> frame_ring_;
+
 	bool is_multicast_ = false;
 	uint16_t multicast_port_[MAX_MEDIA_CHANNEL];
 	std::string multicast_ip_;
+	std::unique_ptr<RtpMulticastSender> multicast_sender_;
+
+	std::atomic<uint64_t> pacing_rate_{0};
+	PacerStats retired_pacer_stats_; /* 已离开客户端的统计, 由 map_mutex_ 保护 */
 	std::atomic_bool has_new_client_;
 
 	static std::atomic_uint last_session_id_;
@@ -12,6 +12,7 @@
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <vector>
 
 namespace xop
 {
@@ -19,8 +20,6 @@ namespace xop
 class MediaSource
 {
 public:
-	using SendFrameCallback = std::function<bool (MediaChannelId channel_id, RtpPacket pkt)>;
-
 	MediaSource() {}
 	virtual ~MediaSource() {}
 
@@ -31,9 +30,9 @@ public:
 
 	virtual std::string GetAttribute()  = 0;
 
-	virtual bool HandleFrame(MediaChannelId channelId, AVFrame frame) = 0;
-	virtual void SetSendFrameCallback(const SendFrameCallback callback)
-	{ send_frame_callback_ = callback; }
+	/* 把一帧打包成 RTP 包追加到 pkts, 同一帧的所有包位于一块缓冲中 (见 RtpPacketArena).
+	   发送只经过 MediaSession::HandleFrame, 整帧一次写入帧环 */
+	virtual bool PacketizeFrame(MediaChannelId channelId, AVFrame frame, std::vector<RtpPacket>& pkts) = 0;
 
 	virtual uint32_t GetPayloadType() const
 	{ return payload_; }
@@ -45,7 +44,6 @@ protected:
 	MediaType media_type_ = NONE;
 	uint32_t  payload_    = 0;
 	uint32_t  clock_rate_ = 0;
-	SendFrameCallback send_frame_callback_;
 };
 
 }
@@ -4,6 +4,7 @@
 #include "RtpConnection.h"
 #include "RtspConnection.h"
 #include "net/SocketUtil.h"
+#include "net/Logger.h"
 
 using namespace std;
 using namespace xop;
@@ -32,6 +33,11 @@ RtpConnection::RtpConnection(std::weak_ptr<TcpConnection> rtsp_connection)
 RtpConnection::~RtpConnection()
 {
 	for(int chn=0; chn<MAX_MEDIA_CHANNEL; chn++) {
+		if (udp_socket_ && rtpfd_[chn] == udp_socket_->GetRtpSocket()) {
+			udp_socket_->RemoveRtcpPeer(peer_rtcp_sddr_[chn]);
+			continue;
+		}
+
 		if(rtpfd_[chn] > 0) {
 			SocketUtil::Close(rtpfd_[chn]);
 		}
@@ -52,6 +58,22 @@ int RtpConnection::GetId() const
 	return rtspConn->GetId();
 }
 
+PacerStats RtpConnection::GetPacerStats() const
+{
+	// 统计可能在其他线程读取, pacer_ 在发送线程中才创建
+	std::shared_ptr<RtpPacer> pacer = std::atomic_load(&pacer_);
+	return pacer ? pacer->GetStats() : PacerStats();
+}
+
+TaskScheduler* RtpConnection::GetTaskScheduler() const
+{
+	auto conn = rtsp_connection_.lock();
+	if (!conn) {
+		return nullptr;
+	}
+	return conn->GetTaskScheduler();
+}
+
 bool RtpConnection::SetupRtpOverTcp(MediaChannelId channel_id, uint16_t rtp_channel, uint16_t rtcp_channel)
 {
 	auto conn = rtsp_connection_.lock();
@@ -69,7 +91,8 @@ bool RtpConnection::SetupRtpOverTcp(MediaChannelId channel_id, uint16_t rtp_chan
 	return true;
 }
 
-bool RtpConnection::SetupRtpOverUdp(MediaChannelId channel_id, uint16_t rtp_port, uint16_t rtcp_port)
+bool RtpConnection::SetupRtpOverUdp(MediaChannelId channel_id, uint16_t rtp_port, uint16_t rtcp_port,
+                                    std::shared_ptr<RtpUdpSocket> udp_socket)
 {
 	auto conn = rtsp_connection_.lock();
 	if (!conn) {
@@ -83,33 +106,43 @@ bool RtpConnection::SetupRtpOverUdp(MediaChannelId channel_id, uint16_t rtp_port
 	media_channel_info_[channel_id].rtp_port = rtp_port;
 	media_channel_info_[channel_id].rtcp_port = rtcp_port;
 
-	std::random_device rd;
-	for (int n = 0; n <= 10; n++) {
-		if (n == 10) {
-			return false;
-		}
+	if (udp_socket) {
+		// 共用服务器的 RTP/RTCP socket, 不再为每个客户端绑定一对端口
+		udp_socket_ = udp_socket;
+		local_rtp_port_[channel_id] = udp_socket->GetRtpPort();
+		local_rtcp_port_[channel_id] = udp_socket->GetRtcpPort();
+		rtpfd_[channel_id] = udp_socket->GetRtpSocket();
+		rtcpfd_[channel_id] = udp_socket->GetRtcpSocket();
+	}
+	else {
+		std::random_device rd;
+		for (int n = 0; n <= 10; n++) {
+			if (n == 10) {
+				return false;
+			}
         
-		local_rtp_port_[channel_id] = rd() & 0xfffe;
-		local_rtcp_port_[channel_id] =local_rtp_port_[channel_id] + 1;
+			local_rtp_port_[channel_id] = rd() & 0xfffe;
+			local_rtcp_port_[channel_id] =local_rtp_port_[channel_id] + 1;
 
-		rtpfd_[channel_id] = ::socket(AF_INET, SOCK_DGRAM, 0);
-		if(!SocketUtil::Bind(rtpfd_[channel_id], "0.0.0.0",  local_rtp_port_[channel_id])) {
-			SocketUtil::Close(rtpfd_[channel_id]);
-			continue;
-		}
+			rtpfd_[channel_id] = ::socket(AF_INET, SOCK_DGRAM, 0);
+			if(!SocketUtil::Bind(rtpfd_[channel_id], "0.0.0.0",  local_rtp_port_[channel_id])) {
+				SocketUtil::Close(rtpfd_[channel_id]);
+				continue;
+			}
 
-		rtcpfd_[channel_id] = ::socket(AF_INET, SOCK_DGRAM, 0);
-		if(!SocketUtil::Bind(rtcpfd_[channel_id], "0.0.0.0", local_rtcp_port_[channel_id])) {
-			SocketUtil::Close(rtpfd_[channel_id]);
-			SocketUtil::Close(rtcpfd_[channel_id]);
-			continue;
+			rtcpfd_[channel_id] = ::socket(AF_INET, SOCK_DGRAM, 0);
+			if(!SocketUtil::Bind(rtcpfd_[channel_id], "0.0.0.0", local_rtcp_port_[channel_id])) {
+				SocketUtil::Close(rtpfd_[channel_id]);
+				SocketUtil::Close(rtcpfd_[channel_id]);
+				continue;
+			}
+
+			break;
 		}
 
-		break;
+		SocketUtil::SetSendBufSize(rtpfd_[channel_id], 50*1024);
 	}
 
-	SocketUtil::SetSendBufSize(rtpfd_[channel_id], 50*1024);
-
 	peer_rtp_addr_[channel_id].sin_family = AF_INET;
 	peer_rtp_addr_[channel_id].sin_addr.s_addr = peer_addr_.sin_addr.s_addr;
 	peer_rtp_addr_[channel_id].sin_port = htons(media_channel_info_[channel_id].rtp_port);
@@ -118,6 +151,17 @@ bool RtpConnection::SetupRtpOverUdp(MediaChannelId channel_id, uint16_t rtp_port
 	peer_rtcp_sddr_[channel_id].sin_addr.s_addr = peer_addr_.sin_addr.s_addr;
 	peer_rtcp_sddr_[channel_id].sin_port = htons(media_channel_info_[channel_id].rtcp_port);
 
+	if (udp_socket) {
+		// 共用的 RTCP socket 按源地址找到本连接, 收到 RTCP 即视为客户端存活
+		std::weak_ptr<TcpConnection> rtsp_connection = rtsp_connection_;
+		udp_socket->AddRtcpPeer(peer_rtcp_sddr_[channel_id], [rtsp_connection] {
+			auto conn = rtsp_connection.lock();
+			if (conn) {
+				((RtspConnection *)conn.get())->KeepAlive();
+			}
+		});
+	}
+
 	media_channel_info_[channel_id].is_setup = true;
 	transport_mode_ = RTP_OVER_UDP;
 
@@ -126,22 +170,7 @@ bool RtpConnection::SetupRtpOverUdp(MediaChannelId channel_id, uint16_t rtp_port
 
 bool RtpConnection::SetupRtpOverMulticast(MediaChannelId channel_id, std::string ip, uint16_t port)
 {
-    std::random_device rd;
-    for (int n = 0; n <= 10; n++) {
-		if (n == 10) {
-			return false;
-		}
-       
-		local_rtp_port_[channel_id] = rd() & 0xfffe;
-		rtpfd_[channel_id] = ::socket(AF_INET, SOCK_DGRAM, 0);
-		if (!SocketUtil::Bind(rtpfd_[channel_id], "0.0.0.0", local_rtp_port_[channel_id])) {
-			SocketUtil::Close(rtpfd_[channel_id]);
-			continue;
-		}
-
-		break;
-    }
-
+	// 组播数据由 MediaSession 统一发送, 这里只记录组播地址, 不再为每个客户端创建 socket
 	media_channel_info_[channel_id].rtp_port = port;
 
 	peer_rtp_addr_[channel_id].sin_family = AF_INET;
@@ -223,67 +252,305 @@ void RtpConnection::SetFrameType(uint8_t frame_type)
 	}
 }
 
-void RtpConnection::SetRtpHeader(MediaChannelId channel_id, RtpPacket pkt)
+void RtpConnection::SetRtpHeader(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header)
 {
-	if((media_channel_info_[channel_id].is_play || media_channel_info_[channel_id].is_record) && has_key_frame_) {
-		media_channel_info_[channel_id].rtp_header.marker = pkt.last;
-		media_channel_info_[channel_id].rtp_header.ts = htonl(pkt.timestamp);
-		media_channel_info_[channel_id].rtp_header.seq = htons(media_channel_info_[channel_id].packet_seq++);
-		memcpy(pkt.data.get()+4, &media_channel_info_[channel_id].rtp_header, RTP_HEADER_SIZE);
+	// 负载由所有客户端共享, 只读; 本连接的 RTP 头写在 header + RTP_TCP_HEAD_SIZE 处
+	media_channel_info_[channel_id].rtp_header.marker = pkt.last;
+	media_channel_info_[channel_id].rtp_header.ts = htonl(pkt.timestamp);
+	media_channel_info_[channel_id].rtp_header.seq = htons(media_channel_info_[channel_id].packet_seq++);
+	memcpy(header + RTP_TCP_HEAD_SIZE, &media_channel_info_[channel_id].rtp_header, RTP_HEADER_SIZE);
+}
+
+bool RtpConnection::StartFromFrame(RtpFrameRing& ring, uint64_t seq)
+{
+	RtpFrameRing::Frame frame;
+	if (is_closed_ || has_key_frame_ || !ring.Get(seq, &frame)) {
+		return false;
 	}
+
+	// 还没有发出过视频帧, 游标可以安全地回退到缓存的关键帧, 之后逐帧发送, 受 TCP 发送队列限制
+	frame_cursor_ = seq;
+	has_frame_cursor_ = true;
+	wait_key_frame_ = false;
+	latency_allowance_ms_ = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - frame.time).count();
+
+	this->DeliverFrames(ring);
+	return true;
 }
 
-int RtpConnection::SendRtpPacket(MediaChannelId channel_id, RtpPacket pkt)
-{    
-	if (is_closed_) {
-		return -1;
+void RtpConnection::DeliverRtpPackets(MediaChannelId channel_id, const std::vector<RtpPacket>& pkts)
+{
+#if defined(__linux) || defined(__linux__)
+	if (transport_mode_ != RTP_OVER_TCP) {
+		DeliverRtpPacketsOverUdp(channel_id, pkts);
+		return;
 	}
-   
-	auto conn = rtsp_connection_.lock();
-	if (!conn) {
-		return -1;
+#endif
+
+	for (size_t i = 0; i < pkts.size(); i++) {
+		if (is_closed_) {
+			break;
+		}
+		if (!this->DeliverRtpPacket(channel_id, pkts[i], i + 1 < pkts.size())) {
+			// 这一帧已不完整, 丢弃剩下的包, 之后的帧直到关键帧都无法解码
+			auto conn = rtsp_connection_.lock();
+			if (conn && !conn->IsClosed()) {
+				LOG_INFO("Client %s:%u send queue is full, waiting for the next key frame.", rtsp_ip_.c_str(), rtsp_port_);
+				wait_key_frame_ = true;
+				if (key_frame_request_callback_) {
+					key_frame_request_callback_();
+				}
+			}
+			break;
+		}
 	}
-	RtspConnection *rtsp_conn = (RtspConnection *)conn.get();
-	bool ret = rtsp_conn->task_scheduler_->AddTriggerEvent([this, channel_id, pkt] {
-		this->SetFrameType(pkt.type);
-		this->SetRtpHeader(channel_id, pkt);
-		if((media_channel_info_[channel_id].is_play || media_channel_info_[channel_id].is_record) && has_key_frame_ ) {            
-			if(transport_mode_ == RTP_OVER_TCP) {
-				SendRtpOverTcp(channel_id, pkt);
+}
+
+void RtpConnection::DeliverFrames(RtpFrameRing& ring)
+{
+	if (!has_frame_cursor_) {
+		uint64_t end_seq = ring.GetEndSeq();
+		frame_cursor_ = end_seq > 0 ? end_seq - 1 : 0;
+		has_frame_cursor_ = true;
+	}
+
+	std::shared_ptr<TcpConnection> conn;
+	if (transport_mode_ == RTP_OVER_TCP) {
+		conn = rtsp_connection_.lock();
+		if (!conn) {
+			return;
+		}
+	}
+
+	RtpFrameRing::Frame frame;
+	delivering_frames_ = true;
+	while (!is_closed_) {
+		bool wait_key_frame = false;
+		uint64_t cursor = ring.Seek(frame_cursor_, &wait_key_frame, latency_allowance_ms_);
+		if (cursor != frame_cursor_) {
+			latency_allowance_ms_ = 0;
+			LOG_INFO("Client %s:%u is %u frames behind, %s.", rtsp_ip_.c_str(), rtsp_port_,
+				(uint32_t)(ring.GetEndSeq() - frame_cursor_),
+				wait_key_frame ? "waiting for the next key frame" : "skipping to the latest key frame");
+			frame_cursor_ = cursor;
+			wait_key_frame_ = wait_key_frame;
+			// 环中没有可跳的关键帧, 让编码器尽快出一个, 不必等到下一个 GOP
+			if (wait_key_frame && key_frame_request_callback_) {
+				key_frame_request_callback_();
 			}
-			else {
-				SendRtpOverUdp(channel_id, pkt);
+		}
+
+		if (!ring.Get(frame_cursor_, &frame)) {
+			// 已追上最新一帧, 之后按正常的延迟预算判断
+			latency_allowance_ms_ = 0;
+			break;
+		}
+
+		// 丢弃整帧, 直到关键帧, 不会把半帧发给客户端
+		if (wait_key_frame_) {
+			if (!frame.key_frame) {
+				frame_cursor_++;
+				continue;
 			}
-                   
-			//media_channel_info_[channel_id].octetCount  += pkt.size;
-			//media_channel_info_[channel_id].packetCount += 1;
+			wait_key_frame_ = false;
 		}
-	});
 
-	return ret ? 0 : -1;
+		if (conn && !conn->ReserveQueue((uint32_t)frame.pkts->size())) {
+			break;
+		}
+		if (pacer_ && !pacer_->CanQueue(frame.bytes)) {
+			break;
+		}
+
+		this->DeliverRtpPackets(frame.channel_id, *frame.pkts);
+		frame_cursor_++;
+	}
+	delivering_frames_ = false;
+}
+
+void RtpConnection::ResumeFrames()
+{
+	// DeliverFrames 内部写出时也可能清空队列, 这时由外层的循环继续
+	if (delivering_frames_ || !has_frame_cursor_) {
+		return;
+	}
+
+	auto ring = frame_ring_.lock();
+	if (ring) {
+		this->DeliverFrames(*ring);
+	}
 }
 
-int RtpConnection::SendRtpOverTcp(MediaChannelId channel_id, RtpPacket pkt)
+bool RtpConnection::DeliverRtpPacket(MediaChannelId channel_id, const RtpPacket& pkt, bool more)
+{
+	// 只统计真正发给客户端的关键帧, 否则 PLAY 之前经过的 I 帧会让客户端从 P 帧开始解码
+	if (media_channel_info_[channel_id].is_play || media_channel_info_[channel_id].is_record) {
+		this->SetFrameType(pkt.type);
+	}
+	if((media_channel_info_[channel_id].is_play || media_channel_info_[channel_id].is_record) && has_key_frame_ ) {            
+		uint8_t header[RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE];
+		this->SetRtpHeader(channel_id, pkt, header);
+		if(transport_mode_ == RTP_OVER_TCP) {
+			if (SendRtpOverTcp(channel_id, pkt, header, more) < 0) {
+				return false;
+			}
+		}
+		else {
+			SendRtpOverUdp(channel_id, pkt, header);
+		}
+               
+		//media_channel_info_[channel_id].octetCount  += pkt.size;
+		//media_channel_info_[channel_id].packetCount += 1;
+	}
+	return true;
+}
+
+int RtpConnection::SendRtpOverTcp(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header, bool more)
 {
 	auto conn = rtsp_connection_.lock();
 	if (!conn) {
 		return -1;
 	}
 
-	uint8_t* rtpPktPtr = pkt.data.get();
-	rtpPktPtr[0] = '$';
-	rtpPktPtr[1] = (char)media_channel_info_[channel_id].rtp_channel;
-	rtpPktPtr[2] = (char)(((pkt.size-4)&0xFF00)>>8);
-	rtpPktPtr[3] = (char)((pkt.size -4)&0xFF);
+	header[0] = '$';
+	header[1] = (char)media_channel_info_[channel_id].rtp_channel;
+	header[2] = (char)(((pkt.size-4)&0xFF00)>>8);
+	header[3] = (char)((pkt.size -4)&0xFF);
 
-	conn->Send((char*)rtpPktPtr, pkt.size);
+	// 头部按连接拷贝, 负载只增加引用计数, 一帧的包合并成尽量少的 writev
+	std::shared_ptr<char> payload(pkt.data, (char*)pkt.data.get());
+	if (!conn->Send((const char*)header, RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE, payload, pkt.size, RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE, more)) {
+		return -1;
+	}
 	return pkt.size;
 }
 
-int RtpConnection::SendRtpOverUdp(MediaChannelId channel_id, RtpPacket pkt)
+#if defined(__linux) || defined(__linux__)
+void RtpConnection::DeliverRtpPacketsOverUdp(MediaChannelId channel_id, const std::vector<RtpPacket>& pkts)
+{
+	if (pacing_rate_ > 0 && pacer_ == nullptr) {
+		TaskScheduler* task_scheduler = GetTaskScheduler();
+		if (task_scheduler != nullptr) {
+			// pacer 的定时器和统计可能让它比连接活得更久, 回调只持有连接的弱引用
+			std::weak_ptr<RtpConnection> weak_conn = shared_from_this();
+			auto pacer = std::make_shared<RtpPacer>(task_scheduler, pacing_rate_,
+				[weak_conn](MediaChannelId channel_id, const RtpPacket* const* pkts, int count) {
+					auto conn = weak_conn.lock();
+					if (!conn) {
+						return false;
+					}
+					return conn->SendUdpPackets(channel_id, pkts, count);
+				}, key_frame_request_callback_);
+			std::atomic_store(&pacer_, pacer);
+		}
+	}
+
+	if (pacer_) {
+		// 一帧的包类型相同, 下面的过滤规则对整帧结果一致, 整帧交给 pacer
+		if (is_closed_ || pkts.empty()) {
+			return;
+		}
+		if (!media_channel_info_[channel_id].is_play && !media_channel_info_[channel_id].is_record) {
+			return;
+		}
+		this->SetFrameType(pkts.front().type);
+		if (has_key_frame_) {
+			pacer_->Push(channel_id, pkts);
+			pacer_->Flush();
+		}
+		return;
+	}
+
+	const RtpPacket* batch[RtpUdpSocket::kMaxBatch];
+	int count = 0;
+
+	for (auto& pkt : pkts) {
+		if (is_closed_) {
+			return;
+		}
+
+		// 与 DeliverRtpPacket 相同的过滤规则, 只是把要发的包先攒起来
+		if (!media_channel_info_[channel_id].is_play && !media_channel_info_[channel_id].is_record) {
+			continue;
+		}
+		this->SetFrameType(pkt.type);
+		if (!has_key_frame_) {
+			continue;
+		}
+
+		batch[count++] = &pkt;
+		if (count == RtpUdpSocket::kMaxBatch) {
+			if (!SendUdpPackets(channel_id, batch, count)) {
+				return;
+			}
+			count = 0;
+		}
+	}
+
+	if (count > 0) {
+		SendUdpPackets(channel_id, batch, count);
+	}
+}
+
+bool RtpConnection::SendUdpPackets(MediaChannelId channel_id, const RtpPacket* const* pkts, int count)
 {
-	int ret = sendto(rtpfd_[channel_id], (const char*)pkt.data.get()+4, pkt.size-4, 0,
-					(struct sockaddr *)&(peer_rtp_addr_[channel_id]), sizeof(struct sockaddr_in));
+	uint8_t headers[RtpUdpSocket::kMaxBatch][RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE];
+	struct iovec iov[RtpUdpSocket::kMaxBatch][2];
+
+	if (is_closed_) {
+		return false;
+	}
+
+	for (int n = 0; n < count; n++) {
+		const RtpPacket& pkt = *pkts[n];
+		this->SetRtpHeader(channel_id, pkt, headers[n]);
+		iov[n][0].iov_base = headers[n] + RTP_TCP_HEAD_SIZE;
+		iov[n][0].iov_len = RTP_HEADER_SIZE;
+		iov[n][1].iov_base = (char*)pkt.data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+		iov[n][1].iov_len = pkt.size - RTP_TCP_HEAD_SIZE - RTP_HEADER_SIZE;
+	}
+
+	if (!RtpUdpSocket::SendPackets(rtpfd_[channel_id], &peer_rtp_addr_[channel_id], iov, count, &udp_gso_)) {
+		Teardown();
+		return false;
+	}
+	return true;
+}
+#endif
+
+int RtpConnection::SendRtpOverUdp(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header)
+{
+	char* payload = (char*)pkt.data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+	uint32_t payload_size = pkt.size - RTP_TCP_HEAD_SIZE - RTP_HEADER_SIZE;
+
+#if defined(__linux) || defined(__linux__)
+	struct iovec iov[2];
+	iov[0].iov_base = header + RTP_TCP_HEAD_SIZE;
+	iov[0].iov_len = RTP_HEADER_SIZE;
+	iov[1].iov_base = payload;
+	iov[1].iov_len = payload_size;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &peer_rtp_addr_[channel_id];
+	msg.msg_namelen = sizeof(struct sockaddr_in);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	int ret = (int)sendmsg(rtpfd_[channel_id], &msg, 0);
+#elif defined(WIN32) || defined(_WIN32)
+	WSABUF bufs[2];
+	bufs[0].buf = (char*)header + RTP_TCP_HEAD_SIZE;
+	bufs[0].len = RTP_HEADER_SIZE;
+	bufs[1].buf = payload;
+	bufs[1].len = payload_size;
+	DWORD bytes_sent = 0;
+	int ret = WSASendTo(rtpfd_[channel_id], bufs, 2, &bytes_sent, 0,
+					(struct sockaddr *)&(peer_rtp_addr_[channel_id]), sizeof(struct sockaddr_in), NULL, NULL);
+	if (ret == 0) {
+		ret = (int)bytes_sent;
+	}
+#endif
                    
 	if(ret < 0) {        
 		Teardown();
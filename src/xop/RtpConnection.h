@@ -9,19 +9,25 @@
 #include <string>
 #include <memory>
 #include <random>
+#include <functional>
 #include "rtp.h"
 #include "media.h"
 #include "net/Socket.h"
 #include "net/TcpConnection.h"
+#include "RtpUdpSocket.h"
+#include "RtpPacer.h"
+#include "RtpFrameRing.h"
 
 namespace xop
 {
 
 class RtspConnection;
 
-class RtpConnection
+class RtpConnection : public std::enable_shared_from_this<RtpConnection>
 {
 public:
+    using KeyFrameRequestCallback = std::function<void()>;
+
     RtpConnection(std::weak_ptr<TcpConnection> rtsp_connection);
     virtual ~RtpConnection();
 
@@ -32,7 +38,9 @@ public:
     { media_channel_info_[channel_id].rtp_header.payload = payload; }
 
     bool SetupRtpOverTcp(MediaChannelId channel_id, uint16_t rtp_channel, uint16_t rtcp_channel);
-    bool SetupRtpOverUdp(MediaChannelId channel_id, uint16_t rtp_port, uint16_t rtcp_port);
+    // udp_socket 不为空时使用服务器共用的 socket, 否则为该通道单独绑定一对端口
+    bool SetupRtpOverUdp(MediaChannelId channel_id, uint16_t rtp_port, uint16_t rtcp_port,
+                         std::shared_ptr<RtpUdpSocket> udp_socket = nullptr);
     bool SetupRtpOverMulticast(MediaChannelId channel_id, std::string ip, uint16_t port);
 
     uint32_t GetRtpSessionId() const
@@ -69,7 +77,13 @@ public:
     void Teardown();
 
     std::string GetRtpInfo(const std::string& rtsp_url);
-    int SendRtpPacket(MediaChannelId channel_id, RtpPacket pkt);
+
+    // 所属 RTSP 连接的调度线程, 连接已释放时返回 nullptr
+    TaskScheduler* GetTaskScheduler() const;
+
+    // 在所属调度线程中调用: 把读游标移到环中序号为 seq 的帧 (缓存的 GOP 的关键帧) 并开始发送,
+    // 只在该连接还没收到过关键帧时生效, 避免与直播包重复; 起点本身的延迟不计入延迟预算
+    bool StartFromFrame(RtpFrameRing& ring, uint64_t seq);
 
     bool IsClosed() const
     { return is_closed_; }
@@ -79,13 +93,42 @@ public:
     bool HasKeyFrame() const
     { return has_key_frame_; }
 
+    // UDP 发送速率上限 (bit/s), 0 表示不限速; 在第一次发送之前设置
+    void SetPacingRate(uint64_t rate_bps)
+    { pacing_rate_ = rate_bps; }
+
+    // 单播的帧环, 在第一次发送之前设置; TCP 发送队列清空后从这里继续发送
+    void SetFrameRing(const std::shared_ptr<RtpFrameRing>& ring)
+    { frame_ring_ = ring; }
+
+    // 客户端丢了帧、需要从关键帧重新开始时调用 (在所属调度线程中); 在第一次发送之前设置
+    void SetKeyFrameRequestCallback(const KeyFrameRequestCallback& callback)
+    { key_frame_request_callback_ = callback; }
+
+    PacerStats GetPacerStats() const;
+
 private:
     friend class RtspConnection;
     friend class MediaSession;
     void SetFrameType(uint8_t frameType = 0);
-    void SetRtpHeader(MediaChannelId channel_id, RtpPacket pkt);
-    int  SendRtpOverTcp(MediaChannelId channel_id, RtpPacket pkt);
-    int  SendRtpOverUdp(MediaChannelId channel_id, RtpPacket pkt);
+    void SetRtpHeader(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header);
+    // more 为 true 表示后面还有同一批的包, TCP 方式下先排队, 到最后一个包再一起写出;
+    // 返回 false 表示 TCP 发送队列拒绝了这个包
+    bool DeliverRtpPacket(MediaChannelId channel_id, const RtpPacket& pkt, bool more = false);
+    // 在所属调度线程中调用, 依次发送一帧的全部 RTP 包
+    void DeliverRtpPackets(MediaChannelId channel_id, const std::vector<RtpPacket>& pkts);
+    // 在所属调度线程中调用, 从读游标开始发送环中的帧: 落后超过延迟预算时整帧跳到最新的关键帧并请求关键帧,
+    // TCP 发送队列或 UDP pacer 放不下一整帧时停在帧边界, TCP 队列清空或下一帧到来时再继续
+    void DeliverFrames(RtpFrameRing& ring);
+    // TCP 发送队列清空后由 RtspConnection 调用
+    void ResumeFrames();
+    int  SendRtpOverTcp(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header, bool more);
+    int  SendRtpOverUdp(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header);
+#if defined(__linux) || defined(__linux__)
+    // UDP 方式下一帧的包用 sendmmsg 分批发送, 每批最多 RtpUdpSocket::kMaxBatch 个; 设置了发送速率时经过 pacer_
+    void DeliverRtpPacketsOverUdp(MediaChannelId channel_id, const std::vector<RtpPacket>& pkts);
+    bool SendUdpPackets(MediaChannelId channel_id, const RtpPacket* const* pkts, int count);
+#endif
 
 	std::weak_ptr<TcpConnection> rtsp_connection_;
     std::string rtsp_ip_;
@@ -95,6 +138,7 @@ private:
     bool is_multicast_ = false;
 
 	bool is_closed_ = false;
+	bool udp_gso_ = true;
 	bool has_key_frame_ = false;
 
     uint8_t  frame_type_ = 0;
@@ -102,6 +146,18 @@ private:
     uint16_t local_rtcp_port_[MAX_MEDIA_CHANNEL];
     SOCKET rtpfd_[MAX_MEDIA_CHANNEL];
     SOCKET rtcpfd_[MAX_MEDIA_CHANNEL];
+    std::shared_ptr<RtpUdpSocket> udp_socket_;
+    uint64_t pacing_rate_ = 0;
+    std::shared_ptr<RtpPacer> pacer_;
+    KeyFrameRequestCallback key_frame_request_callback_;
+
+    // 在 RtpFrameRing 中的读游标, 第一次发送时从最新一帧开始
+    uint64_t frame_cursor_ = 0;
+    bool has_frame_cursor_ = false;
+    bool wait_key_frame_ = false;
+    bool delivering_frames_ = false;
+    int latency_allowance_ms_ = 0;
+    std::weak_ptr<RtpFrameRing> frame_ring_;
 
     struct sockaddr_in peer_addr_;
     struct sockaddr_in peer_rtp_addr_[MAX_MEDIA_CHANNEL];
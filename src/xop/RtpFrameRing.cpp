@@ -0,0 +1,131 @@
+﻿#include "RtpFrameRing.h"
+
+using namespace xop;
+
+RtpFrameRing::RtpFrameRing(size_t max_frames, size_t max_bytes)
+	: max_frames_(max_frames)
+	, max_bytes_(max_bytes)
+{
+
+}
+
+void RtpFrameRing::Push(MediaChannelId channel_id, std::shared_ptr<const std::vector<RtpPacket>> pkts)
+{
+	Frame frame;
+	frame.channel_id = channel_id;
+	frame.time = std::chrono::steady_clock::now();
+	for (auto& pkt : *pkts) {
+		frame.bytes += pkt.size;
+	}
+
+	uint8_t type = pkts->empty() ? 0 : pkts->front().type;
+	frame.pkts = std::move(pkts);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (type == VIDEO_FRAME_I || type == VIDEO_FRAME_P || type == VIDEO_FRAME_B) {
+		has_video_ = true;
+	}
+	// 只有音频时每一帧都可以作为起点
+	frame.key_frame = (type == VIDEO_FRAME_I) || !has_video_;
+
+	bytes_ += frame.bytes;
+	frames_.push_back(std::move(frame));
+	frames_pushed_++;
+
+	// 至少保留最新一帧
+	while (frames_.size() > 1 && (frames_.size() > max_frames_ || bytes_ > max_bytes_)) {
+		bytes_ -= frames_.front().bytes;
+		frames_.pop_front();
+		first_seq_++;
+	}
+}
+
+bool RtpFrameRing::Get(uint64_t seq, Frame* frame)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (seq < first_seq_ || seq >= first_seq_ + frames_.size()) {
+		return false;
+	}
+
+	*frame = frames_[(size_t)(seq - first_seq_)];
+	return true;
+}
+
+uint64_t RtpFrameRing::GetEndSeq()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return first_seq_ + frames_.size();
+}
+
+uint64_t RtpFrameRing::Seek(uint64_t cursor, bool* wait_key_frame, int allowance_ms)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	uint64_t end_seq = first_seq_ + frames_.size();
+	if (cursor >= end_seq) {
+		return cursor;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	auto budget = std::chrono::milliseconds(latency_budget_ms_.load());
+	bool check_time = budget.count() > 0;
+
+	bool lagging = cursor < first_seq_;
+	if (!lagging && check_time) {
+		lagging = now - frames_[(size_t)(cursor - first_seq_)].time > budget + std::chrono::milliseconds(allowance_ms);
+	}
+	if (!lagging) {
+		return cursor;
+	}
+
+	skips_++;
+
+	// 从最新的帧往回找, 关键帧本身也已超过预算时不如等下一个关键帧
+	for (size_t n = frames_.size(); n-- > 0; ) {
+		const Frame& frame = frames_[n];
+		if (check_time && now - frame.time > budget) {
+			break;
+		}
+		if (frame.key_frame) {
+			*wait_key_frame = false;
+			return first_seq_ + n;
+		}
+	}
+
+	*wait_key_frame = true;
+	return end_seq;
+}
+
+bool RtpFrameRing::FindJoinPoint(int max_age_ms, size_t max_frames, size_t max_packets, uint64_t* seq)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (frames_.empty() ||
+		std::chrono::steady_clock::now() - frames_.back().time >= std::chrono::milliseconds(max_age_ms)) {
+		return false;
+	}
+
+	size_t packets = 0;
+	for (size_t n = frames_.size(); n-- > 0 && frames_.size() - n <= max_frames; ) {
+		packets += frames_[n].pkts->size();
+		if (packets > max_packets) {
+			break;
+		}
+		if (frames_[n].key_frame) {
+			*seq = first_seq_ + n;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+FrameRingStats RtpFrameRing::GetStats() const
+{
+	FrameRingStats stats;
+	stats.frames = frames_pushed_;
+	stats.skips = skips_;
+	return stats;
+}
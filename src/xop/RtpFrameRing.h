@@ -0,0 +1,82 @@
+﻿#ifndef XOP_RTP_FRAME_RING_H
+#define XOP_RTP_FRAME_RING_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "media.h"
+#include "rtp.h"
+
+namespace xop
+{
+
+struct FrameRingStats
+{
+	uint64_t frames = 0;          // 写入环的帧数
+	uint64_t skips = 0;           // 客户端落后超过延迟预算后整帧跳过的次数
+};
+
+/* 会话内已打包好的帧组成的环: 推流线程单一写入, 每个客户端在自己的调度线程中按各自的读游标读取.
+   按帧数和字节数限制容量, 内存占用与客户端数量和快慢无关 */
+class RtpFrameRing
+{
+public:
+	struct Frame
+	{
+		MediaChannelId channel_id = channel_0;
+		bool key_frame = false;
+		std::chrono::steady_clock::time_point time;
+		std::shared_ptr<const std::vector<RtpPacket>> pkts;
+		size_t bytes = 0;
+	};
+
+	RtpFrameRing(size_t max_frames = kMaxFrames, size_t max_bytes = kMaxBytes);
+
+	void Push(MediaChannelId channel_id, std::shared_ptr<const std::vector<RtpPacket>> pkts);
+
+	// 序号为 seq 的帧, 已被淘汰或还没有写入时返回 false
+	bool Get(uint64_t seq, Frame* frame);
+
+	// 下一帧将使用的序号
+	uint64_t GetEndSeq();
+
+	/* 读游标 cursor 指向的帧已被淘汰或已超过延迟预算时返回新的游标: 预算内最新的关键帧;
+	   没有这样的关键帧时返回 GetEndSeq(), 并把 *wait_key_frame 置为 true, 之后应丢弃整帧直到下一个关键帧.
+	   没有落后时返回 cursor. allowance_ms 为该客户端额外允许的延迟 (从缓存的关键帧开始播放时起点本身的延迟) */
+	uint64_t Seek(uint64_t cursor, bool* wait_key_frame, int allowance_ms = 0);
+
+	/* 新客户端的起点 (即缓存的 GOP): 最新的关键帧, 从它到最新一帧不超过 max_frames 帧、max_packets 个包;
+	   最新一帧早于 max_age_ms (推流已暂停) 或没有这样的关键帧时返回 false */
+	bool FindJoinPoint(int max_age_ms, size_t max_frames, size_t max_packets, uint64_t* seq);
+
+	// 0 表示不按时间判断落后, 只在帧被淘汰时跳过
+	void SetLatencyBudget(int ms)
+	{ latency_budget_ms_ = ms; }
+
+	FrameRingStats GetStats() const;
+
+private:
+	std::mutex mutex_;
+	std::deque<Frame> frames_;
+	uint64_t first_seq_ = 0;      // frames_.front() 的序号
+	size_t bytes_ = 0;
+	size_t max_frames_ = 0;
+	size_t max_bytes_ = 0;
+	bool has_video_ = false;
+
+	std::atomic<int> latency_budget_ms_{kDefaultLatencyBudgetMs};
+	std::atomic<uint64_t> frames_pushed_{0};
+	std::atomic<uint64_t> skips_{0};
+
+	static const size_t kMaxFrames = 128;      // 约 4 个 GOP (gop_size 30), 每帧占用一块内存池的块
+	static const size_t kMaxBytes = 16 * 1024 * 1024;
+	static const int kDefaultLatencyBudgetMs = 500;
+};
+
+}
+
+#endif
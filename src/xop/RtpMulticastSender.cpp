@@ -0,0 +1,219 @@
+﻿#include "RtpMulticastSender.h"
+#include "RtpUdpSocket.h"
+#include "net/SocketUtil.h"
+#include "net/Logger.h"
+#include <random>
+
+using namespace xop;
+
+RtpMulticastSender::RtpMulticastSender()
+{
+	std::random_device rd;
+
+	for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+		memset(&channels_[chn].rtp_header, 0, sizeof(RtpHeader));
+		channels_[chn].rtp_header.version = RTP_VERSION;
+		channels_[chn].rtp_header.ssrc = htonl(rd());
+		channels_[chn].packet_seq = rd() & 0xffff;
+	}
+}
+
+RtpMulticastSender::~RtpMulticastSender()
+{
+	for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+		if (channels_[chn].rtpfd > 0) {
+			SocketUtil::Close(channels_[chn].rtpfd);
+		}
+
+		if (channels_[chn].rtcpfd > 0) {
+			SocketUtil::Close(channels_[chn].rtcpfd);
+		}
+	}
+}
+
+bool RtpMulticastSender::Open(MediaChannelId channel_id, const std::string& ip, uint16_t port, int ttl)
+{
+	ChannelInfo& channel = channels_[channel_id];
+
+	memset(&channel.rtp_addr, 0, sizeof(channel.rtp_addr));
+	channel.rtp_addr.sin_family = AF_INET;
+	channel.rtp_addr.sin_addr.s_addr = inet_addr(ip.c_str());
+	channel.rtp_addr.sin_port = htons(port);
+	channel.rtcp_addr = channel.rtp_addr;
+	channel.rtcp_addr.sin_port = htons(port + 1);
+
+	channel.rtpfd = ::socket(AF_INET, SOCK_DGRAM, 0);
+	if (channel.rtpfd <= 0) {
+		channel.rtpfd = 0;
+		return false;
+	}
+
+	// IP_MULTICAST_LOOP 保持默认的开启, 同一台机器上的播放器也能收到 (便于在回环上测试)
+	setsockopt(channel.rtpfd, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+	SocketUtil::SetSendBufSize(channel.rtpfd, 1024 * 1024);
+
+	// RTCP 端口绑定失败只影响统计, 不影响发送
+	channel.rtcpfd = ::socket(AF_INET, SOCK_DGRAM, 0);
+	SocketUtil::SetReuseAddr(channel.rtcpfd);
+	if (!SocketUtil::Bind(channel.rtcpfd, "0.0.0.0", port + 1)) {
+		LOG_ERROR("Could not bind multicast RTCP port %u.", port + 1);
+		SocketUtil::Close(channel.rtcpfd);
+		channel.rtcpfd = 0;
+		return true;
+	}
+
+	struct ip_mreq mreq;
+	mreq.imr_multiaddr.s_addr = channel.rtp_addr.sin_addr.s_addr;
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(channel.rtcpfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&mreq, sizeof(mreq)) < 0) {
+		LOG_ERROR("Could not join multicast group %s for RTCP.", ip.c_str());
+	}
+
+	// 转发出去的 RTCP 不能再回到自己这里, 否则会被重复转发
+	unsigned char loop = 0;
+	setsockopt(channel.rtcpfd, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop));
+	setsockopt(channel.rtcpfd, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+#if defined(__linux) || defined(__linux__)
+	int on = 1;
+	setsockopt(channel.rtcpfd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on));
+#endif
+	SocketUtil::SetNonBlock(channel.rtcpfd);
+
+	LOG_INFO("Multicast channel %d: %s:%u, RTCP port %u", (int)channel_id, ip.c_str(), port, port + 1);
+	return true;
+}
+
+void RtpMulticastSender::SetRtpHeader(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header)
+{
+	ChannelInfo& channel = channels_[channel_id];
+	channel.rtp_header.marker = pkt.last;
+	channel.rtp_header.ts = htonl(pkt.timestamp);
+	channel.rtp_header.seq = htons(channel.packet_seq++);
+	memcpy(header, &channel.rtp_header, RTP_HEADER_SIZE);
+}
+
+void RtpMulticastSender::Send(MediaChannelId channel_id, uint8_t payload_type, const std::vector<RtpPacket>& pkts)
+{
+	ChannelInfo& channel = channels_[channel_id];
+	if (channel.rtpfd == 0) {
+		return;
+	}
+
+	// RTCP 很稀疏, 随发送顺便读取, 不单独占用事件循环
+	if (channel.rtcpfd > 0) {
+		HandleRtcp(channel_id);
+	}
+
+	channel.rtp_header.payload = payload_type;
+	uint64_t bytes = 0;
+
+#if defined(__linux) || defined(__linux__)
+	uint8_t headers[RtpUdpSocket::kMaxBatch][RTP_HEADER_SIZE];
+	struct iovec iov[RtpUdpSocket::kMaxBatch][2];
+
+	size_t index = 0;
+	while (index < pkts.size()) {
+		int count = 0;
+		for (; index < pkts.size() && count < RtpUdpSocket::kMaxBatch; index++) {
+			const RtpPacket& pkt = pkts[index];
+			SetRtpHeader(channel_id, pkt, headers[count]);
+			iov[count][0].iov_base = headers[count];
+			iov[count][0].iov_len = RTP_HEADER_SIZE;
+			iov[count][1].iov_base = (char*)pkt.data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+			iov[count][1].iov_len = pkt.size - RTP_TCP_HEAD_SIZE - RTP_HEADER_SIZE;
+			bytes += pkt.size - RTP_TCP_HEAD_SIZE;
+			count++;
+		}
+
+		if (!RtpUdpSocket::SendPackets(channel.rtpfd, &channel.rtp_addr, iov, count, &channel.use_gso)) {
+			LOG_ERROR("Multicast send failed, errno %d.", errno);
+			return;
+		}
+	}
+#elif defined(WIN32) || defined(_WIN32)
+	for (auto& pkt : pkts) {
+		uint8_t header[RTP_HEADER_SIZE];
+		SetRtpHeader(channel_id, pkt, header);
+
+		WSABUF bufs[2];
+		bufs[0].buf = (char*)header;
+		bufs[0].len = RTP_HEADER_SIZE;
+		bufs[1].buf = (char*)pkt.data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+		bufs[1].len = pkt.size - RTP_TCP_HEAD_SIZE - RTP_HEADER_SIZE;
+		DWORD bytes_sent = 0;
+		if (WSASendTo(channel.rtpfd, bufs, 2, &bytes_sent, 0, (struct sockaddr*)&channel.rtp_addr,
+		              sizeof(struct sockaddr_in), NULL, NULL) != 0) {
+			return;
+		}
+		bytes += bytes_sent;
+	}
+#endif
+
+	std::lock_guard<std::mutex> locker(stats_mutex_);
+	stats_.rtp_packets += pkts.size();
+	stats_.rtp_bytes += bytes;
+}
+
+void RtpMulticastSender::HandleRtcp(MediaChannelId channel_id)
+{
+	ChannelInfo& channel = channels_[channel_id];
+	char buf[1500];
+
+	for (int n = 0; n < 16; n++) {
+		bool unicast = false;
+#if defined(__linux) || defined(__linux__)
+		struct iovec iov;
+		iov.iov_base = buf;
+		iov.iov_len = sizeof(buf);
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		int ret = (int)recvmsg(channel.rtcpfd, &msg, 0);
+		if (ret <= 0) {
+			break;
+		}
+
+		for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_PKTINFO) {
+				struct in_pktinfo info;
+				memcpy(&info, CMSG_DATA(cm), sizeof(info));
+				unicast = !IN_MULTICAST(ntohl(info.ipi_addr.s_addr));
+			}
+		}
+#elif defined(WIN32) || defined(_WIN32)
+		int ret = recv(channel.rtcpfd, buf, sizeof(buf), 0);
+		if (ret <= 0) {
+			break;
+		}
+#endif
+
+		std::lock_guard<std::mutex> locker(stats_mutex_);
+		stats_.rtcp_packets++;
+
+		// 复合包中的第一个是 SR(200) 或 RR(201), 第一个报告块的第 5 字节是丢包率
+		uint8_t packet_type = (uint8_t)buf[1];
+		uint8_t report_count = (uint8_t)buf[0] & 0x1f;
+		if (ret >= 8 && packet_type == 201) {
+			stats_.receiver_reports++;
+			if (report_count > 0 && ret >= 8 + 24) {
+				stats_.fraction_lost = (uint8_t)buf[12];
+			}
+		}
+
+		if (unicast) {
+			sendto(channel.rtcpfd, buf, ret, 0, (struct sockaddr*)&channel.rtcp_addr, sizeof(struct sockaddr_in));
+			stats_.rtcp_reflected++;
+		}
+	}
+}
+
+MulticastStats RtpMulticastSender::GetStats()
+{
+	std::lock_guard<std::mutex> locker(stats_mutex_);
+	return stats_;
+}
@@ -0,0 +1,62 @@
+﻿#ifndef XOP_RTP_MULTICAST_SENDER_H
+#define XOP_RTP_MULTICAST_SENDER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "media.h"
+#include "rtp.h"
+#include "net/Socket.h"
+
+namespace xop
+{
+
+struct MulticastStats
+{
+	uint64_t rtp_packets = 0;
+	uint64_t rtp_bytes = 0;
+	uint64_t rtcp_packets = 0;       // 收到的 RTCP 包, 包括组内和单播发来的
+	uint64_t rtcp_reflected = 0;     // 单播发来并转发到组内的 RTCP 包
+	uint64_t receiver_reports = 0;
+	uint8_t  fraction_lost = 0;      // 最近一个接收者报告中的丢包率 (x/256)
+};
+
+/* 组播会话的发送端: 每帧只打包一次, 由本对象以自己的 SSRC/序号一次性发往组播地址,
+   与观看人数无关. RTCP 端口同时加入组播组并接收单播, 单播来的接收者报告转发到组内 (RFC 5760 reflection) */
+class RtpMulticastSender
+{
+public:
+	RtpMulticastSender();
+	~RtpMulticastSender();
+
+	bool Open(MediaChannelId channel_id, const std::string& ip, uint16_t port, int ttl);
+
+	void Send(MediaChannelId channel_id, uint8_t payload_type, const std::vector<RtpPacket>& pkts);
+
+	MulticastStats GetStats();
+
+private:
+	void SetRtpHeader(MediaChannelId channel_id, const RtpPacket& pkt, uint8_t* header);
+	void HandleRtcp(MediaChannelId channel_id);
+
+	struct ChannelInfo
+	{
+		SOCKET rtpfd = 0;
+		SOCKET rtcpfd = 0;
+		struct sockaddr_in rtp_addr;
+		struct sockaddr_in rtcp_addr;
+		RtpHeader rtp_header;
+		uint16_t packet_seq = 0;
+		bool use_gso = true;
+	};
+
+	ChannelInfo channels_[MAX_MEDIA_CHANNEL];
+
+	std::mutex stats_mutex_;
+	MulticastStats stats_;
+};
+
+}
+
+#endif
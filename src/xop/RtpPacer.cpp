@@ -0,0 +1,162 @@
+﻿#include "RtpPacer.h"
+#include <chrono>
+
+using namespace xop;
+
+RtpPacer::RtpPacer(TaskScheduler* task_scheduler, uint64_t rate_bps, const SendCallback& callback,
+                   const KeyFrameRequestCallback& key_frame_callback)
+	: task_scheduler_(task_scheduler)
+	, send_callback_(callback)
+	, key_frame_callback_(key_frame_callback)
+{
+	bytes_per_us_ = (double)rate_bps / 8 / 1000000;
+	max_tokens_ = bytes_per_us_ * kMaxBurstUs;
+	if (max_tokens_ < 2 * 1500) {
+		max_tokens_ = 2 * 1500;
+	}
+	tokens_ = max_tokens_;
+
+	max_queue_bytes_ = (size_t)(bytes_per_us_ * kMaxQueueDelayMs * 1000);
+	if (max_queue_bytes_ < kMinQueueBytes) {
+		max_queue_bytes_ = kMinQueueBytes;
+	}
+
+	last_refill_ = GetTimeNow();
+}
+
+RtpPacer::~RtpPacer()
+{
+	// 定时器回调在 TimerQueue 的锁内执行, 这里不能 RemoveTimer; 定时器下一次触发时发现对象已释放会自行结束
+}
+
+int64_t RtpPacer::GetTimeNow()
+{
+	auto time_point = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(time_point.time_since_epoch()).count();
+}
+
+void RtpPacer::Refill(int64_t now)
+{
+	tokens_ += (now - last_refill_) * bytes_per_us_;
+	if (tokens_ > max_tokens_) {
+		tokens_ = max_tokens_;
+	}
+	last_refill_ = now;
+}
+
+bool RtpPacer::Push(MediaChannelId channel_id, const std::vector<RtpPacket>& pkts)
+{
+	if (pkts.empty()) {
+		return true;
+	}
+
+	// 一帧的包类型相同; 丢过视频帧后参考帧已缺失, 之后的 P/B 帧直到下一个 I 帧都无法解码
+	uint8_t type = pkts.front().type;
+	bool is_video = (type == VIDEO_FRAME_I || type == VIDEO_FRAME_P || type == VIDEO_FRAME_B);
+	if (wait_key_frame_ && is_video && type != VIDEO_FRAME_I) {
+		dropped_packets_ += pkts.size();
+		return false;
+	}
+
+	size_t bytes = 0;
+	for (auto& pkt : pkts) {
+		bytes += pkt.size;
+	}
+
+	// 积压已超过上限说明客户端带宽跟不上, 整帧丢弃, 不把半帧发给客户端; 队列为空时总能放入一帧
+	if (!queue_.empty() && queue_bytes_ + bytes > max_queue_bytes_) {
+		dropped_packets_ += pkts.size();
+		if (is_video && !wait_key_frame_) {
+			wait_key_frame_ = true;
+			if (key_frame_callback_) {
+				key_frame_callback_();
+			}
+		}
+		return false;
+	}
+
+	if (type == VIDEO_FRAME_I) {
+		wait_key_frame_ = false;
+	}
+
+	int64_t now = GetTimeNow();
+	for (auto& pkt : pkts) {
+		Entry entry = { channel_id, pkt, now };
+		queue_.push_back(std::move(entry));
+	}
+	queue_bytes_ += bytes;
+	return true;
+}
+
+bool RtpPacer::Flush()
+{
+	int64_t now = GetTimeNow();
+	Refill(now);
+
+	const RtpPacket* pkts[kMaxBatch];
+	while (!queue_.empty() && tokens_ >= queue_.front().pkt.size) {
+		// 每批只含同一通道的包, 在令牌用完或通道变化处截断
+		MediaChannelId channel_id = queue_.front().channel_id;
+		int count = 0;
+		for (auto& entry : queue_) {
+			if (count == kMaxBatch || entry.channel_id != channel_id || tokens_ < entry.pkt.size) {
+				break;
+			}
+			tokens_ -= entry.pkt.size;
+			pkts[count++] = &entry.pkt;
+
+			uint64_t delay = (uint64_t)(now - entry.enqueue_time);
+			total_delay_us_ += delay;
+			if (delay > max_delay_us_) {
+				max_delay_us_ = delay;
+			}
+		}
+
+		bool ret = send_callback_(channel_id, pkts, count);
+		sent_packets_ += count;
+		for (int n = 0; n < count; n++) {
+			queue_bytes_ -= queue_.front().pkt.size;
+			queue_.pop_front();
+		}
+
+		if (!ret) {
+			queue_.clear();
+			queue_bytes_ = 0;
+			return false;
+		}
+	}
+
+	if (!queue_.empty() && !timer_active_) {
+		std::weak_ptr<RtpPacer> weak_pacer = shared_from_this();
+		task_scheduler_->AddTimer([weak_pacer] {
+			auto pacer = weak_pacer.lock();
+			if (!pacer) {
+				return false;
+			}
+			return pacer->OnTimer();
+		}, kTimerIntervalMs);
+		timer_active_ = true;
+	}
+
+	return true;
+}
+
+bool RtpPacer::OnTimer()
+{
+	// timer_active_ 为 true, Flush 不会再添加定时器; 返回 true 时当前定时器继续, false 时自动移除
+	if (!Flush() || queue_.empty()) {
+		timer_active_ = false;
+		return false;
+	}
+	return true;
+}
+
+PacerStats RtpPacer::GetStats() const
+{
+	PacerStats stats;
+	stats.sent_packets = sent_packets_;
+	stats.dropped_packets = dropped_packets_;
+	stats.total_delay_us = total_delay_us_;
+	stats.max_delay_us = max_delay_us_;
+	return stats;
+}
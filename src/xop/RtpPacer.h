@@ -0,0 +1,103 @@
+﻿#ifndef XOP_RTP_PACER_H
+#define XOP_RTP_PACER_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include "media.h"
+#include "rtp.h"
+#include "net/TaskScheduler.h"
+
+namespace xop
+{
+
+struct PacerStats
+{
+	uint64_t sent_packets = 0;
+	uint64_t dropped_packets = 0;     // 队列超过上限时整帧丢弃的包, 包括之后等待 I 帧期间丢弃的帧
+	uint64_t total_delay_us = 0;      // 已发送包的排队时间之和, 除以 sent_packets 得到平均值
+	uint64_t max_delay_us = 0;
+
+	PacerStats& operator+=(const PacerStats& other)
+	{
+		sent_packets += other.sent_packets;
+		dropped_packets += other.dropped_packets;
+		total_delay_us += other.total_delay_us;
+		if (other.max_delay_us > max_delay_us) {
+			max_delay_us = other.max_delay_us;
+		}
+		return *this;
+	}
+};
+
+/* 令牌桶发送队列: 按设定速率放出 RTP 包, 把 I 帧的突发摊开, 避免冲满 UDP 发送缓冲区.
+   只在所属 TaskScheduler 线程中使用; 有积压时用 1ms 定时器按实际经过的时间补充令牌 */
+class RtpPacer : public std::enable_shared_from_this<RtpPacer>
+{
+public:
+	// 一次放出同一通道的 count 个包, 返回 false 表示发送出错
+	using SendCallback = std::function<bool(MediaChannelId channel_id, const RtpPacket* const* pkts, int count)>;
+	using KeyFrameRequestCallback = std::function<void()>;
+
+	RtpPacer(TaskScheduler* task_scheduler, uint64_t rate_bps, const SendCallback& callback,
+	         const KeyFrameRequestCallback& key_frame_callback = nullptr);
+	~RtpPacer();
+
+	/* 一次放入一整帧的包. 积压超过上限时整帧丢弃并请求关键帧, 之后的 P/B 帧也丢弃, 直到下一个 I 帧;
+	   返回 false 表示该帧被丢弃 */
+	bool Push(MediaChannelId channel_id, const std::vector<RtpPacket>& pkts);
+
+	// 队列还能否放下 bytes 字节的一帧, 与 Push 的判断相同
+	bool CanQueue(size_t bytes) const
+	{ return queue_.empty() || queue_bytes_ + bytes <= max_queue_bytes_; }
+
+	// 按当前令牌放出队首的包, 还有积压时启动定时器
+	bool Flush();
+
+	PacerStats GetStats() const;
+
+private:
+	struct Entry
+	{
+		MediaChannelId channel_id;
+		RtpPacket pkt;
+		int64_t enqueue_time;
+	};
+
+	static int64_t GetTimeNow();
+	void Refill(int64_t now);
+	bool OnTimer();
+
+	TaskScheduler* task_scheduler_ = nullptr;
+	SendCallback send_callback_;
+	KeyFrameRequestCallback key_frame_callback_;
+	std::deque<Entry> queue_;
+	size_t queue_bytes_ = 0;
+
+	double bytes_per_us_ = 0;
+	double tokens_ = 0;
+	double max_tokens_ = 0;
+	size_t max_queue_bytes_ = 0;
+	int64_t last_refill_ = 0;
+
+	bool timer_active_ = false;
+	bool wait_key_frame_ = false;
+
+	std::atomic<uint64_t> sent_packets_{0};
+	std::atomic<uint64_t> dropped_packets_{0};
+	std::atomic<uint64_t> total_delay_us_{0};
+	std::atomic<uint64_t> max_delay_us_{0};
+
+	static const int kMaxBatch = 64;         // 不超过 RtpUdpSocket::kMaxBatch
+	static const int kTimerIntervalMs = 1;
+	static const int kMaxBurstUs = 5000;       // 令牌桶容量: 5ms 的发送量, 容忍定时器晚到
+	static const int kMaxQueueDelayMs = 500;   // 队列上限: 500ms 的发送量
+	static const size_t kMinQueueBytes = 512 * 1024;
+};
+
+}
+
+#endif
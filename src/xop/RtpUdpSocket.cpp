@@ -0,0 +1,215 @@
+﻿#include "RtpUdpSocket.h"
+#include "net/EventLoop.h"
+#include "net/SocketUtil.h"
+#include "net/Logger.h"
+#include <random>
+
+#if defined(__linux) || defined(__linux__)
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+
+using namespace xop;
+
+RtpUdpSocket::RtpUdpSocket(EventLoop* event_loop)
+	: event_loop_(event_loop)
+{
+
+}
+
+RtpUdpSocket::~RtpUdpSocket()
+{
+	if (rtcp_channel_) {
+		event_loop_->RemoveChannel(rtcp_channel_);
+	}
+
+	if (rtpfd_ > 0) {
+		SocketUtil::Close(rtpfd_);
+	}
+
+	if (rtcpfd_ > 0) {
+		SocketUtil::Close(rtcpfd_);
+	}
+}
+
+std::shared_ptr<RtpUdpSocket> RtpUdpSocket::Create(EventLoop* event_loop)
+{
+	std::shared_ptr<RtpUdpSocket> udp_socket(new RtpUdpSocket(event_loop));
+	if (!udp_socket->Open()) {
+		return nullptr;
+	}
+	return udp_socket;
+}
+
+bool RtpUdpSocket::Open()
+{
+	std::random_device rd;
+	for (int n = 0; n <= 10; n++) {
+		if (n == 10) {
+			return false;
+		}
+
+		rtp_port_ = rd() & 0xfffe;
+
+		rtpfd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+		if (!SocketUtil::Bind(rtpfd_, "0.0.0.0", rtp_port_)) {
+			SocketUtil::Close(rtpfd_);
+			rtpfd_ = 0;
+			continue;
+		}
+
+		rtcpfd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+		if (!SocketUtil::Bind(rtcpfd_, "0.0.0.0", rtp_port_ + 1)) {
+			SocketUtil::Close(rtpfd_);
+			SocketUtil::Close(rtcpfd_);
+			rtpfd_ = rtcpfd_ = 0;
+			continue;
+		}
+
+		break;
+	}
+
+	// 所有客户端共用发送缓冲区, 比单个连接时的 50K 大得多
+	SocketUtil::SetSendBufSize(rtpfd_, 2 * 1024 * 1024);
+	SocketUtil::SetNonBlock(rtcpfd_);
+
+	rtcp_channel_.reset(new Channel(rtcpfd_));
+	rtcp_channel_->SetReadCallback([this]() { this->HandleRtcp(); });
+	rtcp_channel_->EnableReading();
+	event_loop_->UpdateChannel(rtcp_channel_);
+
+	LOG_INFO("RTP/RTCP over UDP on port %u/%u", rtp_port_, rtp_port_ + 1);
+	return true;
+}
+
+void RtpUdpSocket::AddRtcpPeer(const struct sockaddr_in& addr, const RtcpCallback& callback)
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	rtcp_peers_[GetPeerKey(addr)] = callback;
+}
+
+void RtpUdpSocket::RemoveRtcpPeer(const struct sockaddr_in& addr)
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	rtcp_peers_.erase(GetPeerKey(addr));
+}
+
+void RtpUdpSocket::HandleRtcp()
+{
+	char buf[1024];
+	struct sockaddr_in addr;
+
+	for (int n = 0; n < 64; n++) {
+		socklen_t addrlen = sizeof(addr);
+		int ret = recvfrom(rtcpfd_, buf, sizeof(buf), 0, (struct sockaddr*)&addr, &addrlen);
+		if (ret <= 0) {
+			break;
+		}
+
+		RtcpCallback callback;
+		{
+			std::lock_guard<std::mutex> locker(mutex_);
+			auto iter = rtcp_peers_.find(GetPeerKey(addr));
+			if (iter != rtcp_peers_.end()) {
+				callback = iter->second;
+			}
+		}
+
+		if (callback) {
+			callback();
+		}
+	}
+}
+
+#if defined(__linux) || defined(__linux__)
+bool RtpUdpSocket::IsGsoSupported()
+{
+	// 旧内核不认识 UDP_SEGMENT, getsockopt 返回 ENOPROTOOPT
+	static const bool supported = [] {
+		int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd < 0) {
+			return false;
+		}
+		int value = 0;
+		socklen_t len = sizeof(value);
+		bool ret = (getsockopt(fd, SOL_UDP, UDP_SEGMENT, &value, &len) == 0);
+		::close(fd);
+		return ret;
+	}();
+	return supported;
+}
+
+bool RtpUdpSocket::SendPackets(SOCKET sockfd, struct sockaddr_in* addr, struct iovec (*iov)[2], int count, bool* use_gso)
+{
+	struct mmsghdr msgs[kMaxBatch];
+	int first_pkt[kMaxBatch];
+	alignas(struct cmsghdr) char control[kMaxBatch][CMSG_SPACE(sizeof(uint16_t))];
+
+	int pkt_index = 0;
+	while (pkt_index < count) {
+		// 相邻且长度相同的包 (如 FU-A 分片) 合成一个 GSO 报文, 由内核切分; 最后一段可以更短
+		int num_msgs = 0;
+		bool gso = *use_gso && IsGsoSupported();
+		memset(msgs, 0, sizeof(msgs));
+
+		for (int n = pkt_index; n < count; ) {
+			size_t seg_size = iov[n][0].iov_len + iov[n][1].iov_len;
+			size_t total = seg_size;
+			int segs = 1;
+			while (gso && n + segs < count && segs < kMaxGsoSegments) {
+				size_t next_size = iov[n + segs][0].iov_len + iov[n + segs][1].iov_len;
+				if (next_size > seg_size || total + next_size > kMaxGsoBytes) {
+					break;
+				}
+				total += next_size;
+				segs++;
+				if (next_size < seg_size) {
+					break;
+				}
+			}
+
+			struct msghdr& msg = msgs[num_msgs].msg_hdr;
+			msg.msg_name = addr;
+			msg.msg_namelen = sizeof(struct sockaddr_in);
+			msg.msg_iov = iov[n];
+			msg.msg_iovlen = 2 * segs;
+			if (segs > 1) {
+				msg.msg_control = control[num_msgs];
+				msg.msg_controllen = sizeof(control[num_msgs]);
+				struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				uint16_t gso_size = (uint16_t)seg_size;
+				memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+			}
+			first_pkt[num_msgs++] = n;
+			n += segs;
+		}
+
+		// sendmmsg 可能只发出一部分, 剩下的接着发
+		int sent = 0;
+		while (sent < num_msgs) {
+			int ret = ::sendmmsg(sockfd, msgs + sent, num_msgs - sent, 0);
+			if (ret < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (gso && (errno == EIO || errno == EINVAL)) {
+					// 网卡不支持校验和卸载等情况下 GSO 会失败, 改回逐包发送剩下的部分
+					*use_gso = false;
+					break;
+				}
+				return false;
+			}
+			sent += ret;
+		}
+
+		pkt_index = (sent < num_msgs) ? first_pkt[sent] : count;
+	}
+
+	return true;
+}
+#endif
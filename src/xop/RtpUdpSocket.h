@@ -0,0 +1,74 @@
+﻿#ifndef XOP_RTP_UDP_SOCKET_H
+#define XOP_RTP_UDP_SOCKET_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "net/Socket.h"
+#include "net/Channel.h"
+
+namespace xop
+{
+
+class EventLoop;
+
+/* 服务器内所有 UDP 客户端共用的一对 RTP/RTCP socket,
+   RTP 按各客户端的对端地址发送, 收到的 RTCP 按源地址分发给对应的连接 */
+class RtpUdpSocket
+{
+public:
+	using RtcpCallback = std::function<void()>;
+
+	static std::shared_ptr<RtpUdpSocket> Create(EventLoop* event_loop);
+	~RtpUdpSocket();
+
+	SOCKET GetRtpSocket() const
+	{ return rtpfd_; }
+
+	SOCKET GetRtcpSocket() const
+	{ return rtcpfd_; }
+
+	uint16_t GetRtpPort() const
+	{ return rtp_port_; }
+
+	uint16_t GetRtcpPort() const
+	{ return rtp_port_ + 1; }
+
+	void AddRtcpPeer(const struct sockaddr_in& addr, const RtcpCallback& callback);
+	void RemoveRtcpPeer(const struct sockaddr_in& addr);
+
+#if defined(__linux) || defined(__linux__)
+	/* 把 count 个 RTP 包 (每包两段: RTP 头和负载) 用 sendmmsg 发往 addr, count 不超过 kMaxBatch.
+	   内核支持 UDP_SEGMENT 时, 连续等长的包合成 GSO 报文; GSO 发送失败时清除 *use_gso 并逐包重发 */
+	static bool SendPackets(SOCKET sockfd, struct sockaddr_in* addr, struct iovec (*iov)[2], int count, bool* use_gso);
+	static bool IsGsoSupported();
+
+	static const int kMaxBatch = 64;
+	static const int kMaxGsoSegments = 64;      // 内核 UDP_MAX_SEGMENTS
+	static const size_t kMaxGsoBytes = 65507;   // 一个 UDP 报文的最大负载
+#endif
+
+private:
+	RtpUdpSocket(EventLoop* event_loop);
+
+	bool Open();
+	void HandleRtcp();
+
+	static uint64_t GetPeerKey(const struct sockaddr_in& addr)
+	{ return ((uint64_t)addr.sin_addr.s_addr << 16) | addr.sin_port; }
+
+	EventLoop* event_loop_ = nullptr;
+	SOCKET rtpfd_ = 0;
+	SOCKET rtcpfd_ = 0;
+	uint16_t rtp_port_ = 0;
+	ChannelPtr rtcp_channel_;
+
+	std::mutex mutex_;
+	std::unordered_map<uint64_t, RtcpCallback> rtcp_peers_;
+};
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "MediaSession.h"
 #include "MediaSource.h"
 #include "net/SocketUtil.h"
+#include "net/MemoryManager.h"
 
 #define USER_AGENT "-_-"
 #define RTSP_DEBUG 0
@@ -30,6 +31,12 @@ RtspConnection::RtspConnection(std::shared_ptr<Rtsp> rtsp, TaskScheduler *task_s
 		this->OnClose();
 	});
 
+	this->SetWriteCompleteCallback([this](std::shared_ptr<TcpConnection> conn) {
+		if (rtp_conn_ != nullptr) {
+			rtp_conn_->ResumeFrames();
+		}
+	});
+
 	alive_count_ = 1;
 
 	rtp_channel_->SetReadCallback([this]() { this->HandleRead(); });
@@ -224,7 +231,7 @@ void RtspConnection::HandleRtcp(SOCKET sockfd)
 
 void RtspConnection::HandleCmdOption()
 {
-	std::shared_ptr<char> res(new char[2048], std::default_delete<char[]>());
+	std::shared_ptr<char> res = AllocBuffer(2048);
 	int size = rtsp_request_->BuildOptionRes(res.get(), 2048);
 	this->SendRtspMessage(res, size);	
 }
@@ -240,7 +247,7 @@ void RtspConnection::HandleCmdDescribe()
 	}
 
 	int size = 0;
-	std::shared_ptr<char> res(new char[4096], std::default_delete<char[]>());
+	std::shared_ptr<char> res = AllocBuffer(4096);
 	MediaSession::Ptr media_session = nullptr;
 
 	auto rtsp = rtsp_.lock();
@@ -283,7 +290,7 @@ void RtspConnection::HandleCmdSetup()
 	}
 
 	int size = 0;
-	std::shared_ptr<char> res(new char[4096], std::default_delete<char[]>());
+	std::shared_ptr<char> res = AllocBuffer(4096);
 	MediaChannelId channel_id = rtsp_request_->GetChannelId();
 	MediaSession::Ptr media_session = nullptr;
 
@@ -325,12 +332,16 @@ void RtspConnection::HandleCmdSetup()
 			uint16_t peer_rtcp_port = rtsp_request_->GetRtcpPort();
 			uint16_t session_id = rtp_conn_->GetRtpSessionId();
 
-			if(rtp_conn_->SetupRtpOverUdp(channel_id, peer_rtp_port, peer_rtcp_port)) {
-				SOCKET rtcp_fd = rtp_conn_->GetRtcpSocket(channel_id);
-				rtcp_channels_[channel_id].reset(new Channel(rtcp_fd));
-				rtcp_channels_[channel_id]->SetReadCallback([rtcp_fd, this]() { this->HandleRtcp(rtcp_fd); });
-				rtcp_channels_[channel_id]->EnableReading();
-				task_scheduler_->UpdateChannel(rtcp_channels_[channel_id]);
+			std::shared_ptr<RtpUdpSocket> udp_socket = rtsp->GetRtpUdpSocket();
+			if(rtp_conn_->SetupRtpOverUdp(channel_id, peer_rtp_port, peer_rtcp_port, udp_socket)) {
+				// 共用 socket 的 RTCP 由 RtpUdpSocket 统一接收
+				if (!udp_socket) {
+					SOCKET rtcp_fd = rtp_conn_->GetRtcpSocket(channel_id);
+					rtcp_channels_[channel_id].reset(new Channel(rtcp_fd));
+					rtcp_channels_[channel_id]->SetReadCallback([rtcp_fd, this]() { this->HandleRtcp(rtcp_fd); });
+					rtcp_channels_[channel_id]->EnableReading();
+					task_scheduler_->UpdateChannel(rtcp_channels_[channel_id]);
+				}
 			}
 			else {
 				goto server_error;
@@ -375,10 +386,19 @@ void RtspConnection::HandleCmdPlay()
 	rtp_conn_->Play();
 
 	uint16_t session_id = rtp_conn_->GetRtpSessionId();
-	std::shared_ptr<char> res(new char[2048], std::default_delete<char[]>());
+	std::shared_ptr<char> res = AllocBuffer(2048);
 
 	int size = rtsp_request_->BuildPlayRes(res.get(), 2048, nullptr, session_id);
 	SendRtspMessage(res, size);
+
+	auto rtsp = rtsp_.lock();
+	if (rtsp) {
+		MediaSession::Ptr media_session = rtsp->LookMediaSession(session_id_);
+		if (media_session) {
+			media_session->SendGopCache(rtp_conn_);
+			media_session->NotifyPlay(rtp_conn_->GetIp(), rtp_conn_->GetPort());
+		}
+	}
 }
 
 void RtspConnection::HandleCmdTeardown()
@@ -390,7 +410,7 @@ void RtspConnection::HandleCmdTeardown()
 	rtp_conn_->Teardown();
 
 	uint16_t session_id = rtp_conn_->GetRtpSessionId();
-	std::shared_ptr<char> res(new char[2048], std::default_delete<char[]>());
+	std::shared_ptr<char> res = AllocBuffer(2048);
 	int size = rtsp_request_->BuildTeardownRes(res.get(), 2048, session_id);
 	SendRtspMessage(res, size);
 
@@ -404,7 +424,7 @@ void RtspConnection::HandleCmdGetParamter()
 	}
 
 	uint16_t session_id = rtp_conn_->GetRtpSessionId();
-	std::shared_ptr<char> res(new char[2048], std::default_delete<char[]>());
+	std::shared_ptr<char> res = AllocBuffer(2048);
 	int size = rtsp_request_->BuildGetParamterRes(res.get(), 2048, session_id);
 	SendRtspMessage(res, size);
 }
@@ -420,7 +440,7 @@ bool RtspConnection::HandleAuthentication()
 			has_auth_ = true;
 		}
 		else {
-			std::shared_ptr<char> res(new char[4096], std::default_delete<char[]>());
+			std::shared_ptr<char> res = AllocBuffer(4096);
 			_nonce = auth_info_->GetNonce();
 			int size = rtsp_request_->BuildUnauthorizedRes(res.get(), 4096, auth_info_->GetRealm().c_str(), _nonce.c_str());
 			SendRtspMessage(res, size);
@@ -447,7 +467,7 @@ void RtspConnection::SendOptions(ConnectionMode mode)
 	rtsp_response_->SetUserAgent(USER_AGENT);
 	rtsp_response_->SetRtspUrl(rtsp->GetRtspUrl().c_str());
 
-	std::shared_ptr<char> req(new char[2048], std::default_delete<char[]>());
+	std::shared_ptr<char> req = AllocBuffer(2048);
 	int size = rtsp_response_->BuildOptionReq(req.get(), 2048);
 	SendRtspMessage(req, size);
 }
@@ -484,14 +504,14 @@ void RtspConnection::SendAnnounce()
 		return;
 	}
 
-	std::shared_ptr<char> req(new char[4096], std::default_delete<char[]>());
+	std::shared_ptr<char> req = AllocBuffer(4096);
 	int size = rtsp_response_->BuildAnnounceReq(req.get(), 4096, sdp.c_str());
 	SendRtspMessage(req, size);
 }
 
 void RtspConnection::SendDescribe()
 {
-	std::shared_ptr<char> req(new char[2048], std::default_delete<char[]>());
+	std::shared_ptr<char> req = AllocBuffer(2048);
 	int size = rtsp_response_->BuildDescribeReq(req.get(), 2048);
 	SendRtspMessage(req, size);
 }
@@ -499,7 +519,7 @@ void RtspConnection::SendDescribe()
 void RtspConnection::SendSetup()
 {
 	int size = 0;
-	std::shared_ptr<char> buf(new char[2048], std::default_delete<char[]>());
+	std::shared_ptr<char> buf = AllocBuffer(2048);
 	MediaSession::Ptr media_session = nullptr;
 
 	auto rtsp = rtsp_.lock();
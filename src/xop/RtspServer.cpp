@@ -1,5 +1,6 @@
 ﻿#include "RtspServer.h"
 #include "RtspConnection.h"
+#include "RtpUdpSocket.h"
 #include "net/SocketUtil.h"
 #include "net/Logger.h"
 
@@ -97,6 +98,22 @@ bool RtspServer::PushFrame(MediaSessionId session_id, MediaChannelId channel_id,
     return false;
 }
 
+std::shared_ptr<RtpUdpSocket> RtspServer::GetRtpUdpSocket()
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+
+    // 第一个 UDP 客户端 SETUP 时才创建; 端口绑定失败后不再重试, 退回每个客户端单独绑定
+    if (!rtp_udp_socket_ && !rtp_udp_socket_failed_) {
+        rtp_udp_socket_ = RtpUdpSocket::Create(event_loop_);
+        if (!rtp_udp_socket_) {
+            LOG_ERROR("Could not bind the shared RTP/RTCP UDP ports.");
+            rtp_udp_socket_failed_ = true;
+        }
+    }
+
+    return rtp_udp_socket_;
+}
+
 TcpConnection::Ptr RtspServer::OnConnect(SOCKET sockfd)
 {	
 	return std::make_shared<RtspConnection>(shared_from_this(), event_loop_->GetTaskScheduler().get(), sockfd);
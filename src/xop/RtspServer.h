@@ -33,9 +33,12 @@ private:
 	RtspServer(xop::EventLoop* loop);
     MediaSession::Ptr LookMediaSession(const std::string& suffix);
     MediaSession::Ptr LookMediaSession(MediaSessionId session_id);
+    virtual std::shared_ptr<RtpUdpSocket> GetRtpUdpSocket();
     virtual TcpConnection::Ptr OnConnect(SOCKET sockfd);
 
     std::mutex mutex_;
+    std::shared_ptr<RtpUdpSocket> rtp_udp_socket_;
+    bool rtp_udp_socket_failed_ = false;
     std::unordered_map<MediaSessionId, std::shared_ptr<MediaSession>> media_sessions_;
     std::unordered_map<std::string, MediaSessionId> rtsp_suffix_map_;
 };
@@ -35,6 +35,15 @@ struct AVFrame
 		timestamp = 0;
 	}
 
+	/* 直接引用外部的引用计数缓冲 (如编码器输出的 AVPacket), 不拷贝数据 */
+	AVFrame(std::shared_ptr<uint8_t> data, uint32_t size)
+		:buffer(std::move(data))
+	{
+		this->size = size;
+		type = 0;
+		timestamp = 0;
+	}
+
 	std::shared_ptr<uint8_t> buffer; /* 帧数据 */
 	uint32_t size;				     /* 帧大小 */
 	uint8_t  type;				     /* 帧类型 */	
@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <cstdint>
+#include "net/MemoryManager.h"
 
 #define RTP_HEADER_SIZE   	   12
 #define MAX_RTP_PAYLOAD_SIZE   1420 //1460  1500-20-12-8
@@ -64,7 +65,14 @@ struct MediaChannelInfo
 struct RtpPacket
 {
 	RtpPacket()
-		: data(new uint8_t[1600], std::default_delete<uint8_t[]>())
+		: data((uint8_t*)xop::Alloc(1600), xop::Free)
+	{
+		type = 0;
+	}
+
+	/* 使用外部缓冲 (如 RtpPacketArena 中的一段), 不再单独分配 */
+	explicit RtpPacket(std::shared_ptr<uint8_t> buffer)
+		: data(std::move(buffer))
 	{
 		type = 0;
 	}
@@ -76,6 +84,40 @@ struct RtpPacket
 	uint8_t  last;
 };
 
+/* 一帧的所有 RTP 包共用一块按帧大小分配的缓冲, 每个包的 data 是指向其中一段的别名 shared_ptr,
+   最后一个包释放时整块缓冲才释放 */
+class RtpPacketArena
+{
+public:
+	RtpPacketArena(uint32_t capacity)
+		: capacity_(capacity) {}
+
+	/* 返回下一个包的写入位置, 保证有 size 字节连续空间; 估算偏小时另开一块 */
+	uint8_t* Reserve(uint32_t size)
+	{
+		if (!buffer_ || used_ + size > capacity_) {
+			capacity_ = size > capacity_ ? size : capacity_;
+			buffer_.reset((uint8_t*)xop::Alloc(capacity_), xop::Free);
+			used_ = 0;
+		}
+		return buffer_.get() + used_;
+	}
+
+	/* 把 Reserve 返回位置开始的 size 字节作为一个包 */
+	RtpPacket Commit(uint32_t size)
+	{
+		RtpPacket pkt(std::shared_ptr<uint8_t>(buffer_, buffer_.get() + used_));
+		pkt.size = size;
+		used_ += size;
+		return pkt;
+	}
+
+private:
+	std::shared_ptr<uint8_t> buffer_;
+	uint32_t capacity_ = 0;
+	uint32_t used_ = 0;
+};
+
 }
 
 #endif
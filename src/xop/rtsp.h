@@ -15,6 +15,8 @@
 namespace xop
 {
 
+class RtpUdpSocket;
+
 struct RtspUrlInfo
 {
 	std::string url;
@@ -92,6 +94,10 @@ protected:
 	virtual MediaSession::Ptr LookMediaSession(MediaSessionId sessionId)
 	{ return nullptr; }
 
+	// 服务器共用的 RTP/RTCP UDP socket, 返回 nullptr 时每个客户端单独绑定端口
+	virtual std::shared_ptr<RtpUdpSocket> GetRtpUdpSocket()
+	{ return nullptr; }
+
 	bool has_auth_info_ = false;
 	std::string realm_;
 	std::string username_;